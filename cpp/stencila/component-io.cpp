@@ -1,9 +1,17 @@
 #include <boost/filesystem.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 
 #include <stencila/component.hpp>
 
 namespace Stencila {
 
+namespace {
+	/**
+	 * Mutex held while the working directory is changed by a `Component::WorkingDirectory`
+	 */
+	boost::recursive_mutex working_directory_mutex_;
+}
+
 Component& Component::initialise(const std::string& address){
 	std::string path = Component::locate(address);
 	if(path.length()) Component::path(path);
@@ -72,6 +80,27 @@ Component& Component::path(const char* path){
 	return Component::path(std::string(path));
 }
 
+Component::WorkingDirectory::WorkingDirectory(const Component& component){
+	auto path = component.path(true);
+	working_directory_mutex_.lock();
+	try {
+		previous_ = boost::filesystem::current_path().string();
+		boost::filesystem::current_path(path);
+	} catch(const std::exception& exc){
+		working_directory_mutex_.unlock();
+		STENCILA_THROW(Exception,"Error changing to directory\n  path: "+path);
+	}
+}
+
+Component::WorkingDirectory::~WorkingDirectory(void){
+	try {
+		boost::filesystem::current_path(previous_);
+	} catch(...){
+		// Destructors must not throw
+	}
+	working_directory_mutex_.unlock();
+}
+
 std::string Component::address(void) const {
 	using namespace boost::filesystem;
 	std::string path = this->path();
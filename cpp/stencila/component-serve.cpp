@@ -101,13 +101,21 @@ std::string Component::request_dispatch(const std::string& address, const std::s
 	}
 }
 
-std::string Component::message_dispatch(const std::string& message) {
+namespace {
+	/**
+	 * Sender for the message currently being dispatched on this thread
+	 */
+	thread_local Component::MessageSender message_sender_;
+}
+
+std::string Component::message_dispatch(const std::string& message, const MessageSender& sender) {
     Wamp::Message request(message);
 	Instance instance = get(request.procedure_address());
 	if(not instance.exists()) {
 		return "404";
 	} else {
 	    Wamp::Message response;
+	    message_sender_ = sender;
 	    try {
 			auto method = Class::get(instance.type()).message_method;
 			if (method) {
@@ -120,10 +128,17 @@ std::string Component::message_dispatch(const std::string& message) {
 	    } catch (...) {
 	        response = request.error("Unknown exception");
 	    }
+	    message_sender_ = nullptr;
+	    // A component may respond later using the sender
+	    if (response.type() == Wamp::Message::NONE) return "";
 	    return response.dump();
 	}
 }
 
+Component::MessageSender Component::message_sender(void) {
+	return message_sender_;
+}
+
 std::string Component::page(void) {
 	return "";
 }
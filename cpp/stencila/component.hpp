@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 #include <tuple>
@@ -78,6 +79,22 @@ public:
 	 */
 	Component& path(const char* path);
 
+	/**
+	 * Changes the working directory to a component's path for its lifetime
+	 *
+	 * The working directory is shared by all threads of the process (e.g. a `Sheet`'s
+	 * asynchronous update and the server thread) so changes to it are serialized:
+	 * other threads wait to change it until this is destroyed, when the previous working
+	 * directory is restored. To avoid deadlocks, create it after acquiring any other locks.
+	 */
+	class WorkingDirectory {
+	public:
+		WorkingDirectory(const Component& component);
+		~WorkingDirectory(void);
+	private:
+		std::string previous_;
+	};
+
 	/**
 	 * Get this component's address
 	 */
@@ -689,14 +706,31 @@ public:
 		const std::string& body
 	);
 
+	/**
+	 * A function which sends a message to the client of a websocket connection
+	 */
+	typedef std::function<void(const std::string&)> MessageSender;
+
 	/**
 	 * Respond to a websocket message to a component address
 	 *
 	 * Gets the component and dispatches to it's `message` method
 	 *
 	 * @param  message    Message text
+	 * @param  sender     Function for sending further messages to the client (optional)
+	 * @return            Response message text, or an empty string if the component will respond using `sender`
+	 */
+	static std::string message_dispatch(const std::string& message, const MessageSender& sender = nullptr);
+
+	/**
+	 * Get the function for sending further messages to the client whose
+	 * message is currently being dispatched
+	 *
+	 * Allows a component's `message` method to send messages in addition to its
+	 * response (e.g. progressive results of a long running method).
+	 * Empty if the client can not be sent further messages.
 	 */
-	static std::string message_dispatch(const std::string& message);
+	static MessageSender message_sender(void);
 
 	/**
 	 * Exception for when a dispathced method is not defined for a class
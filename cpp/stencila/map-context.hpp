@@ -17,6 +17,11 @@ private:
 
 	std::list<Namespace> namespaces_;
 
+	/**
+	 * Items for each of the loops currently being iterated over
+	 */
+	std::list<std::vector<std::string>> items_;
+
 	void set_(const std::string& name, const std::string& value){
 		namespaces_.front()[name] = value;
 	}
@@ -84,25 +89,21 @@ public:
 	bool begin(const std::string& item,const std::string& expression){
 		enter();
 		set_("__item__",item);
-		std::string items_string = get_(expression);
-		std::vector<std::string> items = split(items_string," ");
-		set_("__items__",items_string);
+		// Split the items once, rather than on each step
+		items_.push_front(split(get_(expression)," "));
 		set_("__items_index__","0");
-		set_("__items_size__",string(items.size()));
 		return next();
 	}
 
 	bool next(void){
 		int index = unstring<int>(get_("__items_index__"));
-		int length = unstring<int>(get_("__items_size__"));
-		if(index>=length){
+		const std::vector<std::string>& items = items_.front();
+		if(index>=int(items.size())){
 			// Exit the loop namespace and return false
+			items_.pop_front();
 			exit();
 			return false;
 		} else {
-			// Get the items and split them up
-			std::string items_string = get_("__items__");
-			std::vector<std::string> items = split(items_string," ");
 			// Set the looping variable name
 			std::string name = get_("__item__");
 			set_(name,items[index]);
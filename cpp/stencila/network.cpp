@@ -43,6 +43,15 @@ Server::Server(void){
 	server_.set_reuse_addr(true);
 	// Reset number of restarts
 	restarts_ = 0;
+	// Allow messages to be sent to clients
+	sender_ = std::make_shared<Sender>();
+	sender_->endpoint = &server_;
+}
+
+Server::~Server(void){
+	// Wait for any message being sent and prevent any more
+	boost::lock_guard<boost::mutex> lock(sender_->mutex);
+	sender_->endpoint = nullptr;
 }
 
 std::string Server::url(void) const {
@@ -298,7 +307,17 @@ void Server::message_(connection_hdl hdl, server::message_ptr msg) {
 	std::string response;
 	try {
 		std::string message = msg->get_payload();
-		response = Component::message_dispatch(message);
+		// Components may send further messages to the client (possibly from
+		// other threads and after the connection has been closed, so errors are ignored,
+		// or after this server has been destroyed, so `sender_` is used rather than `this`)
+		auto sender = sender_;
+		response = Component::message_dispatch(message, [sender, hdl](const std::string& text){
+			boost::lock_guard<boost::mutex> lock(sender->mutex);
+			if (sender->endpoint) {
+				websocketpp::lib::error_code error;
+				sender->endpoint->send(hdl, text, opcode::text, error);
+			}
+		});
 	}
 	// `Component::message_dispatch()` should handle most exceptions and return a WAMP
 	// ERROR message. If for some reason that does not happen, the following returns
@@ -309,7 +328,7 @@ void Server::message_(connection_hdl hdl, server::message_ptr msg) {
 	catch(...){
 		response = "Internal server error : unknown exception";			
 	}
-	server_.send(hdl,response,opcode::text);
+	if (response.length()) server_.send(hdl,response,opcode::text);
 }
 
 } // namespace Stencila
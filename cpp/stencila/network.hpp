@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
+
+#include <boost/thread/mutex.hpp>
 
 #define _WEBSOCKETPP_CPP11_STL_
 #include <websocketpp/config/asio.hpp>
@@ -24,6 +27,14 @@ public:
 	 */
 	Server(void);
 
+	/**
+	 * Destroy a `Server`
+	 *
+	 * Any functions for sending messages which are still held by
+	 * components become no-ops
+	 */
+	~Server(void);
+
 	/**
 	 * Get the URL for this `Server`
 	 */
@@ -65,6 +76,21 @@ private:
 	 */
 	unsigned int port_ = 7373;
 
+	/**
+	 * State shared with the functions, created in `message_()`, which components use
+	 * to send further messages to clients
+	 *
+	 * Those functions may be called from other threads (e.g. by a `Sheet`'s asynchronous update)
+	 * and after this server has been destroyed. So, rather than capturing `this`, they share this
+	 * state and only use the server while holding the mutex and if it has not been cleared by
+	 * the destructor.
+	 */
+	struct Sender {
+		boost::mutex mutex;
+		server* endpoint = nullptr;
+	};
+	std::shared_ptr<Sender> sender_;
+
 	/**
 	 * An active websocket connection. Currently empty but could
 	 * be used to store connection information.
@@ -1,15 +1,30 @@
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <limits>
 #include <vector>
+#include <set>
 #include <string>
 #include <algorithm>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/xpressive/xpressive.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/graph/breadth_first_search.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/graph/filtered_graph.hpp>
 #include <boost/graph/graphviz.hpp>
-#include <boost/graph/reverse_graph.hpp>
+#include <boost/graph/strong_components.hpp>
 #include <boost/graph/topological_sort.hpp>
-#include <boost/regex.hpp>
+#include <boost/thread.hpp>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 #include <stencila/debug.hpp>
 #include <stencila/sheet.hpp>
@@ -28,6 +43,11 @@ Sheet::Sheet(const std::string& from) {
 }
 
 Sheet::~Sheet(void) {
+    // Cancel, and wait for, any asynchronous update
+    if (worker_) {
+        updates_++;
+        worker_->join();
+    }
 }
 
 Component::Type Sheet::type(void) {
@@ -35,8 +55,8 @@ Component::Type Sheet::type(void) {
 }
 
 std::string Sheet::meta(const std::string& what) const {
-    for (auto iter : cells_) {
-        Cell& cell = iter.second;
+    for (const auto& iter : cells_) {
+        const Cell& cell = iter.second;
         if (cell.name == what) {
             return cell.value;
         }
@@ -90,29 +110,33 @@ Sheet& Sheet::initialise(const std::string& from) {
     return *this;
 }
 
-Html::Fragment Sheet::html_table(unsigned int rows, unsigned int cols) const {
+Html::Fragment Sheet::html_table(unsigned int rows, unsigned int cols, unsigned int row_first, unsigned int col_first) const {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    auto extents = extent();
     if(rows==0 or cols==0){
         // Generate some sensible defaults
-        auto extents = extent();
         if (rows == 0) rows = std::max(std::min(extents[0]+11, 200u), 50u);
         if (cols == 0) cols = std::max(std::min(extents[1]+11, 100u), 26u);
     }
 
     Html::Fragment frag("<table></table>");
     auto table = frag.select("table");
+    table.attr("data-rows", std::to_string(extents[0] + 1));
+    table.attr("data-cols", std::to_string(extents[1] + 1));
+    if (row_first) table.attr("data-row", std::to_string(row_first));
+    if (col_first) table.attr("data-col", std::to_string(col_first));
     auto tr = table.append("thead").append("tr");
     tr.append("th");
-    for (unsigned int col = 0; col < cols; col++) {
+    for (unsigned int col = col_first; col < col_first + cols; col++) {
         tr.append("th").text(identify_col(col));
     }
     auto tbody = table.append("tbody");
-    for (unsigned int row = 0; row < rows; row++) {
+    for (unsigned int row = row_first; row < row_first + rows; row++) {
         auto tr = tbody.append("tr");
         tr.append("th").text(identify_row(row));
-        for (unsigned int col = 0; col < cols; col++) {
+        for (unsigned int col = col_first; col < col_first + cols; col++) {
             auto td = tr.append("td");
-            auto id = identify(row, col);
-            const auto& iter = cells_.find(id);
+            const auto& iter = cells_.find(key(row, col));
             if (iter != cells_.end()) {
                 const auto& cell = iter->second;
                 if (cell.kind != Cell::blank_) {
@@ -120,6 +144,7 @@ Html::Fragment Sheet::html_table(unsigned int rows, unsigned int cols) const {
                     if (cell.name.length()) td.attr("data-name", cell.name);
                     if (cell.expression.length()) td.attr("data-expr", cell.expression);
                     if (cell.type.length()) td.attr("data-type", cell.type);
+                    if (stale_.count(cell.id)) td.attr("data-stale", "true");
                     td.attr("data-display", cell.display());
                     td.text(cell.value);
                 }
@@ -129,16 +154,450 @@ Html::Fragment Sheet::html_table(unsigned int rows, unsigned int cols) const {
     return frag;
 }
 
+namespace {
+
+/**
+ * Split a line of a TSV into fields and call a function with them
+ *
+ * Mostly as per http://dataprotocols.org/linear-tsv/. Fields are unescaped
+ * into the reused strings of `row`.
+ */
+template<class Function>
+void split_tsv(const char* begin, const char* end, std::vector<std::string>& row, Function& function) {
+    unsigned int size = 0;
+    const char* field = begin;
+    while (true) {
+        auto tab = static_cast<const char*>(std::memchr(field, '\t', end - field));
+        if (row.size() <= size) row.emplace_back();
+        auto& value = row[size++];
+        value.assign(field, tab ? tab : end);
+        if (value.find('\\') != std::string::npos) {
+            boost::replace_all(value, "\\\\", "\\");  // Must come first
+            boost::replace_all(value, "\\t", "\t");
+            boost::replace_all(value, "\\n", "\n");
+            boost::replace_all(value, "\\r", "\r");
+        }
+        if (not tab) break;
+        field = tab + 1;
+    }
+    function(row, size);
+}
+
+/**
+ * Scan a TSV in memory (e.g. a memory mapped file) calling a function with the fields of each row
+ *
+ * @param begin    Start of the TSV
+ * @param end      End of the TSV
+ * @param function Function called with a vector of fields and the number of fields in the row
+ *                 (the vector may have more elements than that from previous rows)
+ */
+template<class Function>
+void scan_tsv(const char* begin, const char* end, Function function) {
+    std::vector<std::string> row;
+    while (begin < end) {
+        auto newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        split_tsv(begin, newline ? newline : end, row, function);
+        if (not newline) break;
+        begin = newline + 1;
+    }
+}
+
+/**
+ * Scan a TSV stream calling a function with the fields of each row
+ *
+ * The stream is read in fixed size chunks so that memory use does not
+ * depend upon the size of the stream.
+ *
+ * @param stream   Input stream
+ * @param function As for `scan_tsv(begin, end, function)`
+ */
+template<class Function>
+void scan_tsv(std::istream& stream, Function function) {
+    std::vector<std::string> row;
+    auto split = [&](const char* begin, const char* end) {
+        split_tsv(begin, end, row, function);
+    };
+
+    // A line which spans chunks
+    std::string line;
+    std::vector<char> chunk(1 << 20);
+    while (stream) {
+        stream.read(chunk.data(), chunk.size());
+        auto count = stream.gcount();
+        if (count <= 0) break;
+        const char* begin = chunk.data();
+        const char* end = begin + count;
+        while (begin < end) {
+            auto newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            if (not newline) {
+                line.append(begin, end);
+                break;
+            }
+            if (line.length()) {
+                line.append(begin, newline);
+                split(line.data(), line.data() + line.size());
+                line.clear();
+            } else {
+                split(begin, newline);
+            }
+            begin = newline + 1;
+        }
+    }
+    // Last line may not have a trailing newline
+    if (line.length()) split(line.data(), line.data() + line.size());
+}
+
+/**
+ * A read only view of the contents of a file
+ *
+ * The file is memory mapped where possible, otherwise it is read into a buffer.
+ * If the file does not exist the view is empty.
+ */
+class FileView {
+ public:
+    explicit FileView(const std::string& path) {
+        #if !defined(_WIN32)
+            int descriptor = ::open(path.c_str(), O_RDONLY);
+            if (descriptor < 0) return;
+            struct stat status;
+            if (::fstat(descriptor, &status) == 0 and status.st_size > 0) {
+                void* address = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (address != MAP_FAILED) {
+                    data_ = static_cast<const char*>(address);
+                    size_ = status.st_size;
+                }
+            }
+            ::close(descriptor);
+        #else
+            std::ifstream file(path, std::ios::binary);
+            buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+        #endif
+    }
+
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    ~FileView(void) {
+        #if !defined(_WIN32)
+            if (data_) ::munmap(const_cast<char*>(data_), size_);
+        #endif
+    }
+
+    const char* data(void) const {
+        return data_;
+    }
+
+    std::size_t size(void) const {
+        return size_;
+    }
+
+ private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    #if defined(_WIN32)
+        std::string buffer_;
+    #endif
+};
+
+/**
+ * Identifier at the start of a cache file (and version of its format)
+ *
+ * The cache file, `out/cache.bin`, has the following format (using native byte order):
+ *
+ *     "STC1" uint32 (number of cells)
+ *     uint32 (length) char[] (id) uint64 (inputs) uint32 (length) char[] (type) uint32 (length) char[] (value)
+ *     ...
+ */
+const char cache_magic[4] = {'S', 'T', 'C', '1'};
+
+/**
+ * Read an integer from a cache file, advancing `begin`
+ */
+template<typename Integer>
+bool cache_read(const char*& begin, const char* end, Integer& value) {
+    if (end - begin < static_cast<std::ptrdiff_t>(sizeof(value))) return false;
+    std::memcpy(&value, begin, sizeof(value));
+    begin += sizeof(value);
+    return true;
+}
+
+/**
+ * Read a length prefixed string from a cache file, advancing `begin`
+ */
+bool cache_read(const char*& begin, const char* end, std::string& value) {
+    uint32_t length;
+    if (not cache_read(begin, end, length) or static_cast<uint32_t>(end - begin) < length) return false;
+    value.assign(begin, length);
+    begin += length;
+    return true;
+}
+
+/**
+ * Scan a cache file calling a function with the id, inputs hash, type and
+ * value of each cell
+ *
+ * @return `false` if the cache is missing or invalid
+ */
+template<class Function>
+bool scan_cache(const FileView& file, Function function) {
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    if (file.size() < sizeof(cache_magic) or std::memcmp(begin, cache_magic, sizeof(cache_magic)) != 0) return false;
+    begin += sizeof(cache_magic);
+
+    uint32_t count;
+    if (not cache_read(begin, end, count)) return false;
+    std::string id, type, value;
+    uint64_t inputs;
+    for (uint32_t index = 0; index < count; index++) {
+        if (not (
+            cache_read(begin, end, id) and cache_read(begin, end, inputs) and
+            cache_read(begin, end, type) and cache_read(begin, end, value)
+        )) return false;
+        function(id, inputs, type, value);
+    }
+    return true;
+}
+
+/**
+ * Identifier at the start of a binary sheet (and version of its format)
+ *
+ * The binary format is columnar, with `n` cells in key order. Each column is
+ * preceded by its size in bytes (a uint32) so that columns can be located without decoding them:
+ *
+ *     "STB1" uint32 (n)
+ *     keys         varint[n] (difference from previous key)
+ *     kinds        uint8[n]
+ *     inputs       uint64[n]
+ *     types        { varint (length) char[] }... (distinct types in order of first use)
+ *     type         varint[n] (index into types)
+ *     names        varint[n] (lengths) then the pool of concatenated names
+ *     expressions  varint[n] (lengths) then the pool of concatenated expressions
+ *     displays     varint[n] (lengths) then the pool of concatenated displays
+ *     values       varint[n] (lengths) then the pool of concatenated values
+ *
+ * Integers are in native byte order, `varint`s are LEB128 (7 bits per byte, least significant first).
+ */
+const char binary_magic[4] = {'S', 'T', 'B', '1'};
+
+/**
+ * Append a varint to a column of a binary sheet
+ */
+void binary_varint(std::string& column, uint64_t value) {
+    while (value >= 0x80) {
+        column.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    column.push_back(static_cast<char>(value));
+}
+
+/**
+ * Read a varint from a column of a binary sheet, advancing `begin`
+ */
+bool binary_varint(const char*& begin, const char* end, uint64_t& value) {
+    value = 0;
+    for (unsigned int shift = 0; begin != end and shift < 64; shift += 7) {
+        uint8_t byte = *begin++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (not (byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/**
+ * Write a column, preceded by its size, to a binary sheet
+ */
+void binary_write(std::ostream& stream, const std::string& column) {
+    uint32_t size = column.size();
+    stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    stream.write(column.data(), size);
+}
+
+/**
+ * A column of a binary sheet being read
+ */
+struct BinaryColumn {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    /**
+     * Locate the column, preceded by its size, advancing `data`
+     */
+    bool locate(const char*& data, const char* data_end) {
+        uint32_t size;
+        if (not cache_read(data, data_end, size) or static_cast<uint32_t>(data_end - data) < size) return false;
+        begin = data;
+        end = data + size;
+        data = end;
+        return true;
+    }
+
+    bool varint(uint64_t& value) {
+        return binary_varint(begin, end, value);
+    }
+
+    template<typename Integer>
+    bool integer(Integer& value) {
+        return cache_read(begin, end, value);
+    }
+
+    /**
+     * Assign `length` characters from this column (a pool) to a string
+     */
+    bool string(uint64_t length, std::string& value) {
+        if (static_cast<uint64_t>(end - begin) < length) return false;
+        value.assign(begin, length);
+        begin += length;
+        return true;
+    }
+};
+
+}
+
 Sheet& Sheet::load(std::istream& stream, const std::string& format) {
-    STENCILA_THROW(Exception, "File extension not valid for loading a sheet\n extension: "+format);
+    if (format == "tsv") {
+        // A grid of cell sources (as produced by `dump()`)
+        clear();
+        unsigned int row = 0;
+        scan_tsv(stream, [&](const std::vector<std::string>& fields, unsigned int size) {
+            for (unsigned int col = 0; col < size; col++) {
+                const auto& source = fields[col];
+                if (source.length()) {
+                    auto id = identify(row, col);
+                    Cell& cell = cells_[key(row, col)];
+                    cell.id = id;
+                    cell.source(source);
+                    names_[cell.name] = id;
+                }
+            }
+            row++;
+        });
+    } else if (format == "bin") {
+        std::string data{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+        load_binary(data.data(), data.size());
+    }
+    else STENCILA_THROW(Exception, "File extension not valid for loading a sheet\n extension: "+format);
     return *this;
 }
 
 Sheet& Sheet::load(const std::string& string, const std::string& format) {
+    if (format == "bin") {
+        return load_binary(string.data(), string.size());
+    }
     std::istringstream stream(string);
     return load(stream, format);
 }
 
+Sheet& Sheet::load_binary(const char* data, std::size_t size) {
+    const char* begin = data;
+    const char* end = data + size;
+    auto invalid = [](const std::string& what) {
+        STENCILA_THROW(Exception, "Invalid binary sheet\n  " + what);
+    };
+    if (size < sizeof(binary_magic) or std::memcmp(begin, binary_magic, sizeof(binary_magic)) != 0) {
+        invalid("unrecognised format");
+    }
+    begin += sizeof(binary_magic);
+
+    uint32_t count;
+    if (not cache_read(begin, end, count)) invalid("missing count");
+    BinaryColumn keys, kinds, inputs, types, type_indices;
+    std::array<BinaryColumn, 4> lengths, pools;
+    bool located = keys.locate(begin, end) and kinds.locate(begin, end) and
+                   inputs.locate(begin, end) and types.locate(begin, end) and
+                   type_indices.locate(begin, end);
+    for (unsigned int column = 0; column < 4; column++) {
+        located = located and lengths[column].locate(begin, end) and pools[column].locate(begin, end);
+    }
+    if (not located) invalid("truncated columns");
+
+    std::vector<std::string> types_list;
+    while (types.begin != types.end) {
+        uint64_t length;
+        types_list.emplace_back();
+        if (not (types.varint(length) and types.string(length, types_list.back()))) invalid("bad types");
+    }
+
+    // Create cells directly from the columns. Since keys are in order, each is
+    // inserted at the end of `cells_` and there is no need to parse cell sources
+    clear();
+    Key key = 0;
+    for (unsigned int index = 0; index < count; index++) {
+        uint64_t delta, type_index;
+        uint8_t kind;
+        uint64_t hash;
+        if (not (
+            keys.varint(delta) and kinds.integer(kind) and inputs.integer(hash) and
+            type_indices.varint(type_index) and type_index < types_list.size()
+        )) invalid("bad cell");
+        key += delta;
+
+        Cell& cell = cells_.emplace_hint(cells_.end(), key, Cell())->second;
+        cell.id = identify(key & 0xFFFFFFFF, key >> 32);
+        cell.kind = static_cast<Cell::Kind>(kind);
+        cell.inputs = hash;
+        cell.type = types_list[type_index];
+        std::array<std::string*, 4> strings = {{&cell.name, &cell.expression, &cell.display_, &cell.value}};
+        for (unsigned int column = 0; column < 4; column++) {
+            uint64_t length;
+            if (not (lengths[column].varint(length) and pools[column].string(length, *strings[column]))) {
+                invalid("bad strings");
+            }
+        }
+        cell.rehash();
+        if (cell.name.length()) names_[cell.name] = cell.id;
+    }
+    return *this;
+}
+
+Sheet& Sheet::dump_binary(std::ostream& stream) {
+    uint32_t count = cells_.size();
+    stream.write(binary_magic, sizeof(binary_magic));
+    stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    std::string keys, kinds, inputs, types, type_indices;
+    std::map<std::string, uint64_t> types_map;
+    std::array<std::string, 4> lengths, pools;
+    Key previous = 0;
+    for (const auto& iter : cells_) {
+        const auto& cell = iter.second;
+        binary_varint(keys, iter.first - previous);
+        previous = iter.first;
+        kinds.push_back(static_cast<char>(cell.kind));
+
+        // As for the evaluation cache, the hash of the inputs to cells with a current value
+        uint64_t hash = 0;
+        if (cell.hash and not stale_.count(cell.id)) {
+            hash = prepared_ ? Sheet::inputs(cell) : cell.inputs;
+        }
+        inputs.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+
+        auto type = types_map.find(cell.type);
+        if (type == types_map.end()) {
+            type = types_map.insert({cell.type, types_map.size()}).first;
+            binary_varint(types, cell.type.size());
+            types.append(cell.type);
+        }
+        binary_varint(type_indices, type->second);
+
+        std::array<const std::string*, 4> strings = {{&cell.name, &cell.expression, &cell.display_, &cell.value}};
+        for (unsigned int column = 0; column < 4; column++) {
+            binary_varint(lengths[column], strings[column]->size());
+            pools[column].append(*strings[column]);
+        }
+    }
+    for (const auto* column : {&keys, &kinds, &inputs, &types, &type_indices}) {
+        binary_write(stream, *column);
+    }
+    for (unsigned int column = 0; column < 4; column++) {
+        binary_write(stream, lengths[column]);
+        binary_write(stream, pools[column]);
+    }
+    return *this;
+}
+
 Sheet& Sheet::dump_script(std::ostream& stream, const std::vector<std::string>& symbols) {
     auto assign = symbols[0];
     auto comment = symbols[1];
@@ -157,7 +616,7 @@ Sheet& Sheet::dump_script(std::ostream& stream, const std::vector<std::string>&
     for (const auto& iter : cells_) {
         const auto& cell = iter.second;
         if (cell.kind==Cell::requirement_ and cell.expression.length()) {
-            stream  << translate(cell.expression)
+            stream  << translate(cell.expression, nullptr, true)
                     << terminate;
             requirements = true;
         }
@@ -167,11 +626,15 @@ Sheet& Sheet::dump_script(std::ostream& stream, const std::vector<std::string>&
     }
     // ...then other cells
     for (const auto& id : order_) {
-        const auto& cell = cells_.at(id);
+        // An id may exist in order_ that is not a cell (including ranges)
+        if (ranges_.count(id)) continue;
+        auto iter = cells_.find(key(id));
+        if (iter == cells_.end()) continue;
+        const auto& cell = iter->second;
         if (cell.kind != Cell::requirement_ and cell.expression.length()) {
             stream  << (cell.name.length()?cell.name:id)
                     << assign
-                    << translate(cell.expression)
+                    << translate(cell.expression, nullptr, true)
                     << terminate;
         }
     }
@@ -199,6 +662,8 @@ Sheet& Sheet::dump(std::ostream& stream, const std::string& format) {
             }
             stream << "\n";
         }
+    } else if (format == "bin") {
+        dump_binary(stream);
     } else if (format == "r" or format=="py") {
         std::string assign = " = ";
         std::string comment = "#";
@@ -226,6 +691,9 @@ Sheet& Sheet::import(const std::string& path) {
     if (ext == ".tsv") {
         std::ifstream file(path);
         load(file, "tsv");
+    } else if (ext == ".bin") {
+        FileView file(path);
+        load_binary(file.data(), file.size());
     }
     else STENCILA_THROW(Exception, "File extension not valid for a sheet\n extension: "+ext);
     return *this;
@@ -233,8 +701,8 @@ Sheet& Sheet::import(const std::string& path) {
 
 Sheet& Sheet::export_(const std::string& path) {
     std::string ext = boost::filesystem::extension(path);
-    if (ext == ".tsv" or ext == ".r" or ext == ".py") {
-        std::ofstream file(path);
+    if (ext == ".tsv" or ext == ".r" or ext == ".py" or ext == ".bin") {
+        std::ofstream file(path, std::ios::binary);
         auto format = ext.substr(1);
         dump(file, format);
     }
@@ -246,74 +714,77 @@ Sheet& Sheet::read(const std::string& directory) {
     // Call base method to set component path
     Component::read(directory);
     
-    // Local function for reading a TSV.
-    // Mostly as per http://dataprotocols.org/linear-tsv/
-    auto read = [](const std::string& path) {
-        std::vector<std::vector<std::string>> cells;
-        std::ifstream file(path);
-        std::string line;
-        while (std::getline(file, line)) {
-            std::vector<std::string> row;
-            boost::split(row, line, std::bind1st(std::equal_to<char>(), '\t'));
-            for(auto& value : row){
-                boost::replace_all(value, "\\\\", "\\");  // Must come first
-                boost::replace_all(value, "\\t", "\t");
-                boost::replace_all(value, "\\n", "\n");
-                boost::replace_all(value, "\\r", "\r");
-            }
-            cells.push_back(row);
-        }
-        return cells;
-    };
-    
-    // Read cell source, types and values files
+    // Reset this sheet and create cells, in place, from the sources file
+    clear();
     auto dir = path() + "/"; 
-    auto sources = read(dir + "sheet.tsv");
-    auto outputs = read(dir + "out/out.tsv");
-    
-    // Local function for getting row of outputs for a cell
-    auto output = [&](const std::string& id) -> std::vector<std::string> {
-        // If outputs is different length to inputs then assume 
-        // they are invalid and return nothing
-        if (outputs.size() != sources.size()) return {};
-        // Search for id and return column if it exists
-        for(const auto& row : outputs) {
-            if (row.size()) {
-                if (row[0] == id) {
-                    return row;
+    unsigned int sources = 0;
+    {
+        FileView file(dir + "sheet.tsv");
+        scan_tsv(file.data(), file.data() + file.size(), [&](const std::vector<std::string>& row, unsigned int size) {
+            sources++;
+            // Lines with an invalid id are skipped rather than making the whole sheet unreadable
+            if (size > 1 and is_id(row[0])) {
+                const auto& id = row[0];
+                Cell& cell = cells_[key(id)];
+                cell = Cell();
+                cell.id = id;
+                cell.source(row[1]);
+                if (size > 2) cell.display(row[2]);
+                names_[cell.name] = id;
+            }
+        });
+    }
+
+    // Get outputs (types and values) for cells
+    unsigned int outputs = 0;
+    {
+        FileView file(dir + "out/out.tsv");
+        scan_tsv(file.data(), file.data() + file.size(), [&](const std::vector<std::string>& row, unsigned int size) {
+            outputs++;
+            if (size > 1 and is_id(row[0])) {
+                auto iter = cells_.find(key(row[0]));
+                if (iter != cells_.end()) {
+                    auto& cell = iter->second;
+                    cell.type = row[1];
+                    if (size > 2) cell.value = row[2];
+                    cell.rehash();
                 }
             }
+        });
+    }
+    // If outputs is different length to sources then assume 
+    // they are invalid and discard them
+    if (outputs != sources) {
+        for (auto& iter : cells_) {
+            iter.second.type.clear();
+            iter.second.value.clear();
+            iter.second.hash = 0;
         }
-        return {};
-    };
-    
-    // Create a bunch of new cells from sources file, getting
-    // outputs for that cell if they are available
-    std::vector<Cell> cells;
-    for (const auto& row : sources) {
-        auto row_size = row.size();
-        if (row_size>1) {
-            auto id = row[0];
-            auto source = row[1];
-            Cell cell;
-            cell.id = id;
-            cell.source(source);
-            if (row_size>2) cell.display(row[2]);
-            auto outs = output(id);
-            auto outs_size = outs.size();
-            if (outs_size>1) cell.type = outs[1];
-            if (outs_size>2) cell.value = outs[2];
-            cells.push_back(cell);
-        }
-    }
-
-    // Reset this sheet with those cells;
-    clear();
-    update(cells, false);
+    }
 
-    // If a context is attached then read that too
+    // Get cached outputs, along with the hashes of the inputs used to produce them, 
+    // so that cells can be restored without executing them
+    bool cached = false;
+    {
+        FileView file(dir + "out/cache.bin");
+        cached = scan_cache(file, [&](const std::string& id, uint64_t inputs, const std::string& type, const std::string& value) {
+            if (not is_id(id)) return;
+            auto iter = cells_.find(key(id));
+            if (iter != cells_.end()) {
+                auto& cell = iter->second;
+                cell.type = type;
+                cell.value = value;
+                cell.inputs = inputs;
+                cell.rehash();
+            }
+        });
+    }
+
+    // If a context is attached then read that too. Only then can cells be restored
+    // since the spread needs to hold their values
     if(spread_) {
         spread_->read(path()+"/out/");
+        restored_ = cached;
     }
     
     return *this;
@@ -339,6 +810,18 @@ Sheet& Sheet::write(const std::string& directory) {
     boost::filesystem::create_directories(dir+"/out");
     std::ofstream sources(dir + "/sheet.tsv");
     std::ofstream outputs(dir + "/out/out.tsv");
+    std::ofstream cache(dir + "/out/cache.bin", std::ios::binary);
+    auto cache_write = [&](const void* data, std::size_t size) {
+        cache.write(static_cast<const char*>(data), size);
+    };
+    auto cache_string = [&](const std::string& value) {
+        uint32_t length = value.size();
+        cache_write(&length, sizeof(length));
+        cache_write(value.data(), length);
+    };
+    uint32_t count = cells_.size();
+    cache_write(cache_magic, sizeof(cache_magic));
+    cache_write(&count, sizeof(count));
     for (const auto& iter : cells_) {
         const auto& cell = iter.second;
         sources << cell.id << "\t" << escape(cell.source());
@@ -346,6 +829,17 @@ Sheet& Sheet::write(const std::string& directory) {
         if (display.length()) sources << "\t" << display;
         sources << "\n";
         outputs << cell.id << "\t" << escape(cell.type)     << "\t" << escape(cell.value) << "\n";
+
+        // Hash of the inputs to the cell (if it has a current value and the sheet has
+        // not been updated since being read, the hash read from the cache)
+        uint64_t inputs = 0;
+        if (cell.hash and not stale_.count(cell.id)) {
+            inputs = prepared_ ? Sheet::inputs(cell) : cell.inputs;
+        }
+        cache_string(cell.id);
+        cache_write(&inputs, sizeof(inputs));
+        cache_string(cell.type);
+        cache_string(cell.value);
     }
 
     // If a context is attached then write that too
@@ -358,13 +852,25 @@ Sheet& Sheet::write(const std::string& directory) {
 
 Sheet& Sheet::store(void) {
     write();
+    export_(path() + "/out/sheet.bin");
     Component::store();
     return *this;
 }
 
 Sheet& Sheet::restore(void) {
     Component::restore();
-    read();
+    // Restore from the binary snapshot if there is one since that is faster
+    // to load than the sources and outputs files
+    auto snapshot = path() + "/out/sheet.bin";
+    if (boost::filesystem::exists(snapshot)) {
+        import(snapshot);
+        if (spread_) {
+            spread_->read(path() + "/out/");
+            restored_ = true;
+        }
+    } else {
+        read();
+    }
     return *this;
 }
 
@@ -373,9 +879,10 @@ std::string Sheet::page(const Instance& instance) {
 }
 
 std::string Sheet::page(void) const {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+
     // Get base document
     Html::Document doc = Component_page_doc<Sheet>(*this);
-    Html::Node head = doc.find("head");
     Html::Node body = doc.find("body");
 
     // Add sheet to main#content
@@ -415,32 +922,129 @@ std::string Sheet::request(const std::string& verb, const std::string& name, con
     return Component::request(verb, name, body, &callback);
 }
 
+namespace {
+
+/**
+ * Get cell changes from a JSON array of cell ids, sources and displays
+ */
+std::vector<Sheet::Cell> cells_changes(const Json::Document& arg) {
+    if(not arg.is<Json::Array>()){
+        STENCILA_THROW(Exception, "Array required as first argument");
+    }
+
+    std::vector<Sheet::Cell> changes;
+    for (unsigned int index = 0; index < arg.size(); index++) {
+        Sheet::Cell cell;
+        auto json = arg[index];
+        cell.id = json["id"].as<std::string>();
+        cell.source(
+            json["source"].as<std::string>()
+        );
+        cell.display(
+            json["display"].as<std::string>()
+        );
+        changes.push_back(cell);
+    }
+    return changes;
+}
+
+/**
+ * Get a JSON object representing an updated cell
+ */
+Json::Document cell_update(const Sheet::Cell& cell) {
+    Json::Document json = Json::Object();
+    json.append("id", cell.id);
+    json.append("kind", cell.kind_string());
+    json.append("type", cell.type);
+    json.append("value", cell.value);
+    json.append("display", cell.display());
+    return json;
+}
+
+}
+
 Wamp::Message Sheet::message(const Wamp::Message& message) {
+    // If the client accepts progressive results, and can be sent further messages, then updates
+    // are done asynchronously: each updated cell is sent in a progressive result as soon as it is
+    // computed, followed by a final (empty) result, or an error, when the update is done
+    auto sender = Component::message_sender();
+    if (sender and message.progressive() and message.procedure_method() == "update") {
+        auto changes = cells_changes(message.args()[0]);
+        update_async(
+            changes,
+            [=](const Cell& cell) {
+                Json::Document cells = Json::Array();
+                cells.append(cell_update(cell));
+                sender(message.result(cells, true).dump());
+            },
+            [=](bool cancelled, const std::string& error) {
+                if (error.length()) sender(message.error(error).dump());
+                else sender(message.result(Json::Array()).dump());
+            }
+        );
+        // No response now, the final result is sent when the update is done
+        return Wamp::Message();
+    }
+
     std::function<Json::Document(const std::string&, const Json::Document&)> callback = [&](const std::string& name, const Json::Document& args){
         return this->call(name, args);
     };
     return Component::message(message, &callback);
 }
 
+Json::Document Sheet::tile(unsigned int row, unsigned int col, unsigned int rows, unsigned int cols) const {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    Json::Document result = Json::Object();
+    result.append("row", row);
+    result.append("col", col);
+    result.append("rows", rows);
+    result.append("cols", cols);
+    Json::Document cells = Json::Array();
+    if (rows and cols) {
+        // Cells are ordered by column and then row so each column of the
+        // tile is a contiguous range of `cells_`
+        for (auto col_index = col; col_index < col + cols; col_index++) {
+            auto iter = cells_.lower_bound(key(row, col_index));
+            auto end = cells_.upper_bound(key(row + rows - 1, col_index));
+            for (; iter != end; iter++) {
+                const auto& cell = iter->second;
+                if (cell.kind == Cell::blank_) continue;
+                auto json = cell_update(cell);
+                if (stale_.count(cell.id)) json.append("stale", true);
+                cells.append(json);
+            }
+        }
+    }
+    result.append("cells", cells);
+    return result;
+}
+
 Json::Document Sheet::call(const std::string& name, const Json::Document& args) {
+    // Calls are made on the server thread, so those which use cells or the spread hold
+    // `updating_` (as do the methods which other calls delegate to e.g. `tile()`,
+    // `functions()`) so that they do not race with any asynchronous update
 
     if(name=="write"){
 
+        boost::lock_guard<boost::recursive_mutex> lock(updating_);
         write();
         return "{}";
 
     } else if(name=="store"){
 
+        boost::lock_guard<boost::recursive_mutex> lock(updating_);
         store();
         return "{}";
 
     } else if(name=="restore"){
 
+        boost::lock_guard<boost::recursive_mutex> lock(updating_);
         restore();
         return "{}";
 
     } else if (name == "cell") {
 
+        boost::lock_guard<boost::recursive_mutex> lock(updating_);
         Cell cell;
         auto id = args["id"].as<std::string>();
         if (id.length()) {
@@ -448,7 +1052,7 @@ Json::Document Sheet::call(const std::string& name, const Json::Document& args)
                 STENCILA_THROW(Exception, "Not a valid id"); 
             }
             else {
-                auto iter = cells_.find(id);
+                auto iter = cells_.find(key(id));
                 if (iter != cells_.end()) {
                     cell = iter->second;
                 } else {
@@ -461,7 +1065,7 @@ Json::Document Sheet::call(const std::string& name, const Json::Document& args)
             if (name.length()) {
                 auto iter = names_.find(name);
                 if (iter != names_.end()) {
-                    cell = cells_[iter->second];
+                    cell = cells_[key(iter->second)];
                 } else {
                     STENCILA_THROW(Exception, "Not found");
                 }
@@ -470,6 +1074,12 @@ Json::Document Sheet::call(const std::string& name, const Json::Document& args)
             }
         }
 
+        // Stale cells are executed on demand
+        if (stale(cell.id)) {
+            compute({cell.id});
+            cell = cells_.at(key(cell.id));
+        }
+
         Json::Document result = Json::Object();
         result.append("id", id);
         result.append("expression", cell.expression);
@@ -502,38 +1112,36 @@ Json::Document Sheet::call(const std::string& name, const Json::Document& args)
         auto func = function(name);
         return func.json();
 
-    } else  if (name == "update"){
+    } else if (name == "tile") {
 
-        auto arg = args[0];
-        if(not arg.is<Json::Array>()){
-            STENCILA_THROW(Exception, "Array required as first argument");
-        }
+        auto row = args[0].as<unsigned int>();
+        auto col = args[1].as<unsigned int>();
+        auto rows = args[2].as<unsigned int>();
+        auto cols = args[3].as<unsigned int>();
+        // The tile is in view so execute any stale cells within it first
+        if (rows and cols) viewport(row, col, row + rows - 1, col + cols - 1);
+        return tile(row, col, rows, cols);
+
+    } else if (name == "viewport") {
+
+        std::vector<Cell> updates = viewport(
+            args[0].as<unsigned int>(), args[1].as<unsigned int>(),
+            args[2].as<unsigned int>(), args[3].as<unsigned int>()
+        );
 
-        std::vector<Cell> changed;
-        for (unsigned int index = 0; index < arg.size(); index++) {
-            Cell cell;
-            auto json = arg[index];
-            cell.id = json["id"].as<std::string>();
-            cell.source(
-                json["source"].as<std::string>()
-            );
-            cell.display(
-                json["display"].as<std::string>()
-            );
-            changed.push_back(cell);
+        Json::Document result = Json::Array();
+        for (const auto& cell : updates) {
+            result.append(cell_update(cell));
         }
+        return result;
+
+    } else  if (name == "update"){
 
-        std::vector<Cell> updates = update(changed);
+        std::vector<Cell> updates = update(cells_changes(args[0]));
 
         Json::Document result = Json::Array();
-        for (auto cell : updates) {
-            Json::Document json = Json::Object();
-            json.append("id", cell.id);
-            json.append("kind", cell.kind_string());
-            json.append("type", cell.type);
-            json.append("value", cell.value);
-            json.append("display", cell.display());
-            result.append(json);
+        for (const auto& cell : updates) {
+            result.append(cell_update(cell));
         }
         return result;
 
@@ -543,53 +1151,116 @@ Json::Document Sheet::call(const std::string& name, const Json::Document& args)
 }
 
 std::string Sheet::identify_row(unsigned int row) {
-    return string(row+1);
+    return std::to_string(row+1);
 }
 
 std::string Sheet::identify_col(unsigned int col) {
-    std::string id;
+    // Fill a buffer from the end: 7 letters is sufficient for all 32 bit indices
+    char buffer[8];
+    char* end = buffer + sizeof(buffer);
+    char* begin = end;
     while (true) {
-        int mod = (col % 26) + 65;
+        *(--begin) = static_cast<char>((col % 26) + 65);
         col /= 26;
-        id = static_cast<char>(mod) + id;
-        if (col > 0) col--;
-        else if (col == 0) break;
+        if (col == 0) break;
+        col--;
     }
-    return id;
+    return std::string(begin, end);
 }
 
 std::string Sheet::identify(unsigned int row, unsigned int col) {
     return identify_col(col)+identify_row(row);
 }
 
-boost::regex Sheet::id_regex("^([A-Z]+)([1-9][0-9]*)$");
+std::string Sheet::identify_r1c1(unsigned int row, unsigned int col) {
+    return "R" + std::to_string(row+1) + "C" + std::to_string(col+1);
+}
+
+namespace {
+
+/**
+ * Scan a 1-based number (no leading zeros) from the characters
+ * at `iter`, advancing it. Returns 0 if there is no valid number.
+ */
+unsigned int scan_number(const char*& iter, const char* end) {
+    if (iter == end or *iter < '1' or *iter > '9') return 0;
+    uint64_t number = 0;
+    while (iter != end and *iter >= '0' and *iter <= '9') {
+        number = number*10 + (*iter - '0');
+        if (number > 0xFFFFFFFF) return 0;
+        iter++;
+    }
+    return static_cast<unsigned int>(number);
+}
+
+}
+
+bool Sheet::scan_id(const char* begin, const char* end, unsigned int& row, unsigned int& col) {
+    const char* iter = begin;
+
+    // Column letters (bijective base-26)
+    uint64_t letters = 0;
+    while (iter != end and *iter >= 'A' and *iter <= 'Z') {
+        letters = letters*26 + (*iter - 64);
+        if (letters > 0xFFFFFFFF) return false;
+        iter++;
+    }
+    if (iter == begin) return false;
+
+    // Row number
+    auto row_number = scan_number(iter, end);
+    if (not row_number or iter != end) return false;
+    row = row_number - 1;
+    col = static_cast<unsigned int>(letters - 1);
+    return true;
+}
 
 bool Sheet::is_id(const std::string& id){
-    return boost::regex_match(id, id_regex);
+    unsigned int row, col;
+    return scan_id(id.data(), id.data() + id.size(), row, col);
 }
 
 unsigned int Sheet::index_row(const std::string& row) {
-    return unstring<unsigned int>(row)-1;
+    const char* iter = row.data();
+    const char* end = iter + row.size();
+    auto number = scan_number(iter, end);
+    if (not number or iter != end) STENCILA_THROW(Exception, "Invalid row id\n  row: "+row);
+    return number-1;
 }
 
 unsigned int Sheet::index_col(const std::string& col) {
+    // Bijective base-26 (A=1...Z=26) converted to 0-based index
     auto index = 0u;
-    auto rank = 1u;
     for(char letter : col){
-        index += (col.length()-rank++)*26+(letter-65);
+        index = index*26 + (letter-64);
     }
-    return index;
+    return index-1;
 }
 
 std::array<unsigned int, 2> Sheet::index(const std::string& id) {
-    boost::smatch match;
-    if(boost::regex_match(id, match, id_regex)){
-        return {index_row(match[2]),index_col(match[1])};
+    unsigned int row, col;
+    if (scan_id(id.data(), id.data() + id.size(), row, col)) {
+        return {row, col};
     } else {
         STENCILA_THROW(Exception, "Invalid cell id\n  id: "+id);
     }
 }
 
+std::array<unsigned int, 2> Sheet::index_r1c1(const std::string& id) {
+    const char* iter = id.data();
+    const char* end = iter + id.size();
+    if (iter != end and *iter == 'R') {
+        iter++;
+        auto row_number = scan_number(iter, end);
+        if (row_number and iter != end and *iter == 'C') {
+            iter++;
+            auto col_number = scan_number(iter, end);
+            if (col_number and iter == end) return {row_number - 1, col_number - 1};
+        }
+    }
+    STENCILA_THROW(Exception, "Invalid R1C1 cell id\n  id: "+id);
+}
+
 std::vector<std::string> Sheet::interpolate(
     const std::string& col1, const std::string& row1, 
     const std::string& col2, const std::string& row2
@@ -614,10 +1285,10 @@ std::vector<std::string> Sheet::interpolate(
 std::array<unsigned int, 2> Sheet::extent(void) const {
     auto row = 0u;
     auto col = 0u;
-    for(auto iter : cells_){
-        auto indices = index(iter.first);
-        row = std::max(row,indices[0]);
-        col = std::max(col,indices[1]);
+    // Cells are ordered by column so the maximum column is that of the last cell
+    if (cells_.size()) col = cells_.rbegin()->first >> 32;
+    for (const auto& iter : cells_) {
+        row = std::max(row, static_cast<unsigned int>(iter.first & 0xFFFFFFFF));
     }
     return {row,col};
 }
@@ -638,36 +1309,46 @@ Sheet& Sheet::cells(const std::vector<std::array<std::string, 2>>& sources) {
 }
 
 Sheet::Cell& Sheet::cell(const std::string& id) {
-    auto iter = cells_.find(id);
+    auto iter = cells_.find(key(id));
     if (iter == cells_.end()) STENCILA_THROW(Exception, "Cell does not exist\n id: "+id)
     else return iter->second;
 }
 
 Sheet::Cell& Sheet::cell(unsigned int row, unsigned int col) {
-    return cell(identify(row, col));
+    auto iter = cells_.find(key(row, col));
+    if (iter == cells_.end()) STENCILA_THROW(Exception, "Cell does not exist\n id: "+identify(row, col))
+    else return iter->second;
 }
 
 Sheet::Cell* Sheet::cell_pointer(const std::string& id) {
-    auto iter = cells_.find(id);
+    auto iter = cells_.find(key(id));
     if (iter == cells_.end()) return nullptr;
     else return &iter->second;
 }
 
 Sheet::Cell* Sheet::cell_pointer(unsigned int row, unsigned int col) {
-    return cell_pointer(identify(row, col));
+    auto iter = cells_.find(key(row, col));
+    if (iter == cells_.end()) return nullptr;
+    else return &iter->second;
 }
 
 Sheet& Sheet::attach(std::shared_ptr<Spread> spread) {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     spread_ = spread;
+    translations_.clear();
+    restored_ = false;
     return *this;
 }
 
 Sheet& Sheet::detach(void) {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     spread_ = nullptr;
+    translations_.clear();
+    restored_ = false;
     return *this;
 }
 
-std::string Sheet::translate(const std::string& expression) {
+std::string Sheet::translate(const std::string& expression, std::vector<std::string>* ranges, bool standalone) {
     using namespace boost::xpressive;
     if (not spread_) STENCILA_THROW(Exception, "No spread attached to this sheet");
 
@@ -698,8 +1379,20 @@ std::string Sheet::translate(const std::string& expression) {
                         auto parts = cells_expr.nested_results().begin();
                         auto left = *(parts);
                         auto right = *(++parts);
-                        auto ids = interpolate(left[col],left[row],right[col],right[row]);
-                        auto combo = spread_->collect(ids);
+                        // Pass the range's corners to the spread, falling back to collecting
+                        // each cell within it if the spread does not support ranges
+                        auto col1 = index_col(left[col]);
+                        auto col2 = index_col(right[col]);
+                        auto row1 = index_row(left[row]);
+                        auto row2 = index_row(right[row]);
+                        if (col2 < col1 or row2 < row1) STENCILA_THROW(Exception, "Invalid cell range");
+                        auto combo = standalone ? "" : spread_->range(row1, col1, row2, col2);
+                        if (combo.length()) {
+                            if (ranges) ranges->push_back(left.str() + ":" + right.str());
+                        } else {
+                            auto ids = interpolate(left[col],left[row],right[col],right[row]);
+                            combo = spread_->collect(ids);
+                        }
                         translation += combo;
                     }
                     else if(cells_expr.regex_id()==sunion.regex_id()){
@@ -714,261 +1407,751 @@ std::string Sheet::translate(const std::string& expression) {
     return translation;
 }
 
-std::array<std::string, 2> Sheet::evaluate(const std::string& expression) {
-    if (not spread_) STENCILA_THROW(Exception, "No spread attached to this sheet");
-
-    // Change to the sheet's directory
-    boost::filesystem::path current_path = boost::filesystem::current_path();
-    boost::filesystem::path path = boost::filesystem::path(Component::path(true));
-    try {
-        boost::filesystem::current_path(path);
-    } catch(const std::exception& exc){
-        STENCILA_THROW(Exception,"Error changing to directory\n  path: "+path.string());
+const Sheet::Translation& Sheet::translation(const std::string& expression) {
+    auto iter = translations_.find(expression);
+    if (iter != translations_.end()) return iter->second;
+    translations({expression});
+    return translations_.at(expression);
+}
+
+void Sheet::translations(const std::vector<std::string>& expressions) {
+    // Translate expressions which are not already cached
+    std::set<std::string> seen;
+    std::vector<std::string> pending;
+    std::vector<std::vector<std::string>> ranges;
+    std::vector<std::string> translated;
+    for (const auto& expression : expressions) {
+        if (translations_.count(expression) or not seen.insert(expression).second) continue;
+        ranges.emplace_back();
+        translated.push_back(translate(expression, &ranges.back()));
+        pending.push_back(expression);
     }
+    if (pending.empty()) return;
 
-    std::string type;
-    std::string value;
+    // Get the list of variable names each expression depends upon in
+    // a single batch. There may be a syntax error in an expression
+    // so capture those and set dependencies to none
+    std::vector<std::string> dependencies;
     try {
-        auto type_value = spread_->evaluate(translate(expression));
-        auto space = type_value.find(" ");
-        type = type_value.substr(0, space);
-        value = type_value.substr(space+1);
-    } catch (...){
-        // Ensure return to current directory even if there is an exception
-        boost::filesystem::current_path(current_path);
-        throw;
+        dependencies = spread_->depends_batch(translated);
+    } catch(...) {
+        dependencies.clear();
     }
-    // Return to the current directory
-    boost::filesystem::current_path(current_path);
+    dependencies.resize(pending.size());
+
+    for (unsigned int index = 0; index < pending.size(); index++) {
+        Translation translation;
+        translation.expression = translated[index];
+        const auto& depends = dependencies[index];
+        for (std::string depend : split(depends, ",")) {
+            if (depends.length()) {
+                // Replace cell names with cell ids
+                auto iter = names_.find(depend);
+                if (iter != names_.end()) {
+                    depend = iter->second;
+                }
+                // Remove anything that is not an id (e.g. function name)
+                if (is_id(depend)) {
+                    translation.depends.push_back(depend);
+                }
+            }
+        }
+        // Ranges are dependencies as a whole, rather than each cell within them
+        for (const auto& range : ranges[index]) {
+            if (std::find(translation.depends.begin(), translation.depends.end(), range) == translation.depends.end()) {
+                translation.depends.push_back(range);
+            }
+        }
+        translations_[pending[index]] = translation;
+    }
+}
+
+std::array<std::string, 2> Sheet::evaluate(const std::string& expression) {
+    if (not spread_) STENCILA_THROW(Exception, "No spread attached to this sheet");
+    // Translations and the spread are also used by any asynchronous update
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+
+    // Change to the sheet's directory
+    WorkingDirectory directory(*this);
 
-    return {type, value};
+    auto type_value = spread_->evaluate(translate(expression));
+    auto space = type_value.find(" ");
+    return {type_value.substr(0, space), type_value.substr(space+1)};
 }
 
 std::vector<Sheet::Cell> Sheet::update(const std::vector<Sheet::Cell>& changes, bool execute) {
+    return update(changes, execute, nullptr, nullptr);
+}
+
+Sheet& Sheet::update_async(
+    const std::vector<Cell>& changes,
+    const std::function<void(const Cell&)>& notify,
+    const std::function<void(bool, const std::string&)>& done
+) {
+    // Cancel any update in progress now rather than when the worker starts
+    updates_++;
+    // Each worker waits for the previous one so that updates are done in order
+    auto previous = worker_;
+    worker_ = std::make_shared<boost::thread>([this, changes, notify, done, previous]() mutable {
+        if (previous) {
+            previous->join();
+            previous.reset();
+        }
+        bool cancelled = false;
+        std::string error;
+        try {
+            update(changes, true, notify, &cancelled);
+        } catch (const Exception& exc) {
+            // Use the message since `Exception::what()` returns a temporary
+            error = exc.message();
+        } catch (const std::exception& exc) {
+            error = exc.what();
+        } catch (...) {
+            error = "Unknown exception";
+        }
+        if (done) done(cancelled, error);
+    });
+    return *this;
+}
+
+std::vector<Sheet::Cell> Sheet::update(
+    const std::vector<Cell>& changes, bool execute,
+    const std::function<void(const Cell&)>& notify, bool* cancelled,
+    const std::vector<std::string>& requested
+) {
+    // Cancel any update in progress and wait for it to stop
+    auto generation = ++updates_;
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    if (cancelled) *cancelled = false;
+
+    // Change to the sheet's directory (after acquiring `updating_`, see `WorkingDirectory`)
+    WorkingDirectory directory(*this);
+
     std::vector<Sheet::Cell> updates;
+    auto updated_cell = [&](const Cell& cell) {
+        updates.push_back(cell);
+        if (notify) notify(cell);
+    };
 
-    // Change to the sheet's directory
-    boost::filesystem::path current_path = boost::filesystem::current_path();
-    boost::filesystem::path path = boost::filesystem::path(Component::path(true));
-    try {
-        boost::filesystem::current_path(path);
-    } catch(const std::exception& exc){
-        STENCILA_THROW(Exception,"Error changing to directory\n  path: "+path.string());
+    std::vector<std::string> cells_changed;
+    if (changes.size()){
+        // Updating only changed cells
+        // Need to copy the change into the existing (or
+        // newly created) cell
+        for (auto cell : changes) {
+            auto id = cell.id;
+            Cell* pointer = cell_pointer(id);
+            if(pointer){
+                // Existing cell so copy over but retain the hash of its
+                // current value so that it is possible to detect if re-executing
+                // it actually changes its value
+                if (pointer->kind != cell.kind) covered_ = -1;
+                auto hash = pointer->hash;
+                *pointer = cell;
+                pointer->hash = hash;
+                // TODO deal with any change in name by clearing the
+                // name from the context and the name mapping
+            }
+            else {
+                // New cell so insert
+                cells_.insert({key(id),cell});
+                covered_ = -1;
+                // Store any name
+                auto& name = names_[cell.name];
+                if (cell.name.length() and name != id) {
+                    // Dependencies on this name may now resolve to a different id
+                    translations_.clear();
+                }
+                name = id;
+            }
+            cells_changed.push_back(id);
+        }
+    } else {
+        // Updating all existing cells
+        for (const auto& iter : cells_) {
+            cells_changed.push_back(iter.second.id);
+        }
     }
 
-    try {
-        std::vector<std::string> cells_changed;
-        if (changes.size()){
-            // Updating only changed cells
-            // Need to copy the change into the existing (or
-            // newly created) cell
-            for (auto cell : changes) {
-                auto id = cell.id;
-                Cell* pointer = cell_pointer(id);
-                if(pointer){
-                    // Existing cell so copy over
-                    *pointer = cell;
-                    // TODO deal with any change in name by clearing the
-                    // name from the context and the name mapping
+    // If no spread, don't go any further.
+    // This suffices for an initial read
+    if(not execute or not spread_) return updates;
+
+    // Cells not executed by a cancelled update need to be (in lazy mode
+    // stale cells are only executed when they are needed, see below)
+    if (stale_.size() and not lazy_) {
+        std::set<std::string> ids(cells_changed.begin(), cells_changed.end());
+        for (const auto& id : stale_) {
+            if (cells_.count(key(id)) and not ids.count(id)) {
+                cells_changed.push_back(id);
+            }
+        }
+        stale_.clear();
+    }
+
+    // Cells which were in a cycle are executed again in case it has been broken
+    if (cycles_.size()) {
+        std::set<std::string> ids(cells_changed.begin(), cells_changed.end());
+        auto names = boost::get(boost::vertex_name, graph_);
+        for (const auto& cycle : cycles_) {
+            for (auto vertex : cycle) {
+                const auto& id = names[vertex];
+                if (is_id(id) and cells_.count(key(id)) and ids.insert(id).second) {
+                    cells_changed.push_back(id);
                 }
-                else {
-                    // New cell so insert
-                    cells_.insert({id,cell});
-                    // Store any name
-                    names_[cell.name] = id;
+            }
+        }
+    }
+
+    // Create list of cells for which dependency needs to be updated
+    // If necessary update dependency graph based on all cells
+    // not just those that have been updated
+    std::vector<std::string> cells_dependency;
+    if (not prepared_) {
+        for (const auto& iter : cells_) {
+            cells_dependency.push_back(iter.second.id);
+        }
+    } else {
+        cells_dependency = cells_changed;
+    }
+
+    // Translate the expressions of these cells, getting their dependencies
+    // from the spread in a single batch
+    std::vector<std::string> expressions;
+    for (const auto& id : cells_dependency) {
+        const Cell& cell = Sheet::cell(id);
+        if (cell.kind != Cell::requirement_ and cell.kind != Cell::manual_ and cell.expression.length()) {
+            expressions.push_back(cell.expression);
+        }
+    }
+    translations(expressions);
+
+    // Update of dependency graph
+    std::vector<std::string> cells_requirements;
+    for (auto id : cells_dependency) {
+        Cell& cell = Sheet::cell(id);
+
+        // Create vertex for the cell
+        auto vertex = Sheet::vertex(id);
+
+        // Connect the cell to any ranges that it falls within
+        if (ranges_.size()) {
+            auto position = index(id);
+            auto column = range_columns_.find(position[1]);
+            if (column != range_columns_.end()) for (const auto& range : column->second) {
+                const auto& corners = ranges_.at(range);
+                if (position[0] >= corners[0] and position[0] <= corners[2]) {
+                    auto range_vertex = vertices_.at(range);
+                    if (not boost::edge(vertex, range_vertex, graph_).second) {
+                        invalidate();
+                        boost::add_edge(vertex, range_vertex, graph_);
+                        if (prepared_ and ordered_) {
+                            ordered_ = reorder(vertex, range_vertex);
+                        }
+                    }
                 }
-                cells_changed.push_back(id);
             }
+        }
+
+        // Requirement and manual kind cells don't need to have dependencies
+        // determined
+        if (cell.kind==Cell::requirement_) {
+            cells_requirements.push_back(id);
+        } else if (cell.kind==Cell::manual_) {
+
         } else {
-            // Updating all existing cells
-            for (const auto& iter : cells_) {
-                cells_changed.push_back(iter.first);
+            // Get the list of variable names this cell depends upon
+            if (cell.expression.length()) {
+                cell.depends = translation(cell.expression).depends;
+            } else {
+                cell.depends.clear();
             }
         }
 
-        // If no spread, don't go any further.
-        // This suffices for an initial read
-        if(not execute or not spread_) return updates;
+        // Vertices of cells that this one depends upon
+        std::vector<Vertex> sources;
+        if (cell.kind != Cell::requirement_ and cell.kind != Cell::manual_) {
+            for (auto depend : cell.depends) {
+                sources.push_back(Sheet::vertex(depend));
+            }
+        }
 
-        // Create list of cells for which dependency needs to be updated
-        // If necessary update dependency graph based on all cells
-        // not just those that have been updated
-        std::vector<std::string> cells_dependency;
-        if (not prepared_) {
-            for (const auto& iter : cells_) {
-                cells_dependency.push_back(iter.first);
+        // Only replace inward edges if the dependencies have changed since
+        // removing an edge requires a search of the source vertex's out edges
+        // (which, for a cell with many dependants, makes a full update quadratic)
+        std::vector<Vertex> existing;
+        boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+        for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+            existing.push_back(boost::source(*edge_iter, graph_));
+        }
+        if (sources == existing) continue;
+
+        // Create inward edges from cells that this one depends upon
+        // and, if the order is already known, shift the affected region of it
+        invalidate();
+        boost::clear_in_edges(vertex, graph_);
+        for (auto vertex_from : sources) {
+            boost::add_edge(vertex_from, vertex, graph_);
+            if (prepared_ and ordered_) {
+                ordered_ = reorder(vertex_from, vertex);
             }
-        } else {
-            cells_dependency = cells_changed;
         }
+    }
+
+    // Topological sort of the whole graph is only required initially
+    // or if a previous edge insertion resulted in a cycle
+    if (not prepared_ or not ordered_) sort();
 
-        // Update of dependency graph
-        std::vector<std::string> cells_requirements;
-        for (auto id : cells_dependency) {
-            Cell& cell = Sheet::cell(id);
+    // Next time, don't need to update all dependencies
+    if (not prepared_) prepared_ = true;
+
+    // Ensure output directory is present
+    boost::filesystem::create_directories(boost::filesystem::path(Component::path(true)) / "out");
+
+    // Execute each requirement (amongst changed cells)
+    for (auto id : cells_requirements) {
+        Cell& cell = Sheet::cell(id);
+        spread_->execute(cell.expression);
+    }
+
+    // Flags for each vertex, indexed by vertex (`boost::vecS` vertices are contiguous
+    // integers) rather than searching lists of ids, so that recalculation is linear:
+    //   changed - the cell was amongst those changed
+    //   visited - the cell is a changed cell or a successor of one
+    //   pending - the cell is waiting to be executed
+    //   updated - the cell has been executed and its value changed
+    auto vertex_count = boost::num_vertices(graph_);
+    std::vector<bool> changed(vertex_count, false);
+    std::vector<bool> visited(vertex_count, false);
+    std::vector<bool> pending(vertex_count, false);
+    std::vector<bool> updated(vertex_count, false);
+
+    // Determine the cells which may need to be re-executed: those that have
+    // changed and all of their successors. Only these, rather than the entire
+    // order, are visited and in topological order.
+    std::vector<Vertex> stack;
+    for (const auto& id : cells_changed) {
+        auto vertex = vertices_.at(id);
+        changed[vertex] = true;
+        if (not visited[vertex]) {
+            visited[vertex] = true;
+            stack.push_back(vertex);
+        }
+    }
+    std::vector<Vertex> dirty;
+    while (stack.size()) {
+        auto vertex = stack.back();
+        stack.pop_back();
+        dirty.push_back(vertex);
+        boost::graph_traits<Graph>::out_edge_iterator edge_iter, edge_end;
+        for (boost::tie(edge_iter,edge_end) = out_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+            auto successor_vertex = boost::target(*edge_iter, graph_);
+            if (not visited[successor_vertex]) {
+                visited[successor_vertex] = true;
+                stack.push_back(successor_vertex);
+            }
+        }
+    }
 
-            // Create vertex for the cell or clear edges for existing vertex
-            Vertex vertex;
+    // In lazy mode, only the cells within the viewport, or requested, and the cells which
+    // they depend upon need to be executed. These are found by searching backwards from them
+    // through dirty cells, stale cells and ranges (since a dirty cell's predecessors can only be
+    // dirty if it is). Stale cells which are found are executed as though they have changed.
+    auto names = boost::get(boost::vertex_name, graph_);
+    std::vector<bool> needed;
+    if (lazy_) {
+        needed.resize(vertex_count, false);
+        auto passable = [&](Vertex vertex) {
+            const auto& id = names[vertex];
+            return visited[vertex] or ranges_.count(id) or stale_.count(id);
+        };
+
+        std::vector<std::string> targets = requested;
+        for (auto row = viewport_[0]; row <= viewport_[2]; row++) {
+            for (auto col = viewport_[1]; col <= viewport_[3]; col++) {
+                auto iter = cells_.find(key(row, col));
+                if (iter != cells_.end()) targets.push_back(iter->second.id);
+            }
+        }
+        for (const auto& id : targets) {
             auto iter = vertices_.find(id);
-            if (iter == vertices_.end()) {
-                vertex =  boost::add_vertex(id, graph_);
-                vertices_[id] = vertex;
-            } else {
-                vertex = iter->second;
-                boost::clear_in_edges(vertex, graph_);
+            if (iter == vertices_.end()) continue;
+            auto vertex = iter->second;
+            if (not needed[vertex] and passable(vertex)) {
+                needed[vertex] = true;
+                stack.push_back(vertex);
             }
-            // Requirement and manual kind cells don't need to have dependencies
-            // determined
-            if (cell.kind==Cell::requirement_) {
-                cells_requirements.push_back(id);
-            } else if (cell.kind==Cell::manual_) {
+        }
 
-            } else {
-                // Get the list of variable names this cell depends upon
-                if (cell.expression.length()) {
-                    auto spread_expr = translate(cell.expression);
-                    // There may be a syntax error in the expression
-                    // so capture those and set dependencies to none
-                    std::string depends;
-                    try {
-                        depends = spread_->depends(spread_expr);
-                    } catch(...) {
-                        depends = "";
-                    }
-                    cell.depends.clear();
-                    for (std::string depend : split(depends, ",")) {
-                        if (depends.length()) {
-                            // Replace cell names with cell ids
-                            auto iter = names_.find(depend);
-                            if (iter != names_.end()) {
-                                depend = iter->second;
-                            }
-                            // Remove anything that is not an id (e.g. function name)
-                            if (is_id(depend)) {
-                                cell.depends.push_back(depend);
-                            }
-                        }
-                    }
-                } else {
-                    cell.depends.clear();
-                }
-                // Create inward edges from cells that this one depends upon
-                for (auto depend : cell.depends) {
-                    Vertex vertex_from;
-                    auto iter = vertices_.find(depend);
-                    if (iter == vertices_.end()) {
-                        vertex_from =  boost::add_vertex(depend, graph_);
-                        vertices_[depend] = vertex_from;
-                    } else {
-                        vertex_from = iter->second;
-                    }
-                    boost::add_edge(vertex_from, vertex, graph_);
+        while (stack.size()) {
+            auto vertex = stack.back();
+            stack.pop_back();
+            if (not visited[vertex]) {
+                visited[vertex] = true;
+                dirty.push_back(vertex);
+            }
+            if (stale_.count(names[vertex])) changed[vertex] = true;
+            boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+            for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                auto predecessor_vertex = boost::source(*edge_iter, graph_);
+                if (not needed[predecessor_vertex] and passable(predecessor_vertex)) {
+                    needed[predecessor_vertex] = true;
+                    stack.push_back(predecessor_vertex);
                 }
             }
         }
+    }
 
-        // Topological sort
-        std::vector<Vertex> vertices;
-        try {
-            topological_sort(graph_, std::back_inserter(vertices));
+    std::sort(dirty.begin(), dirty.end(), [this](Vertex a, Vertex b) {
+        return positions_[a] < positions_[b];
+    });
+
+    // Partition the dirty cells into levels. A cell's level is one more than the highest
+    // level of any of its dirty predecessors so the cells within a level have no
+    // mutual dependencies (i.e. they are an antichain) and can be executed in any
+    // order, or concurrently.
+    std::vector<unsigned int> levels(vertex_count, 0);
+    std::vector<std::vector<Vertex>> antichains;
+    for (auto vertex : dirty) {
+        unsigned int level = 0;
+        boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+        for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+            auto predecessor_vertex = boost::source(*edge_iter, graph_);
+            if (visited[predecessor_vertex]) {
+                level = std::max(level, levels[predecessor_vertex] + 1);
+            }
         }
-        catch (const std::invalid_argument& ) {
-            STENCILA_THROW(Exception, "There is cyclic dependency in the sheet");
-            // TODO should we create a graph visitor which shows what the cycle is?
+        levels[vertex] = level;
+        if (antichains.size() <= level) antichains.resize(level + 1);
+        antichains[level].push_back(vertex);
+    }
+
+    // Cells within a cycle can not be executed, nor can the cells which depend upon
+    // them (directly or through a range) so they are marked as errored. All cells
+    // depending upon a cycle are dirty since cells in cycles are always changed.
+    std::vector<bool> errored;
+    std::map<Vertex, std::string> cyclic;
+    if (cycles_.size()) {
+        errored.resize(vertex_count, false);
+        auto ids = cycles();
+        for (unsigned int index = 0; index < cycles_.size(); index++) {
+            auto message = "Cyclic dependency between cells: " + boost::algorithm::join(ids[index], ", ");
+            for (auto vertex : cycles_[index]) {
+                cyclic[vertex] = message;
+                errored[vertex] = true;
+            }
         }
-        std::vector<std::string> ids;
-        for (auto vertex : vertices) {
-            ids.push_back(boost::get(boost::vertex_name, graph_)[vertex]);
+        for (auto vertex : dirty) {
+            boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+            for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                if (errored[boost::source(*edge_iter, graph_)]) {
+                    errored[vertex] = true;
+                    break;
+                }
+            }
         }
-        reverse(ids.begin(), ids.end());
-        order_ = ids;
+    }
 
-        // Next time, don't need to update all dependencies
-        if (not prepared_) prepared_ = true;
+    // Cells are only executed concurrently if the spread says that is safe
+    auto threads = std::max(spread_->concurrency(), 1u);
 
-        // Ensure output directory is present
-        boost::filesystem::create_directories(path / "out");
+    // Cells which need to be set in the spread
+    struct Task {
+        Vertex vertex;
+        Cell* cell;
+        std::string expression;
+        std::string type_value;
+    };
+    std::vector<Task> tasks;
+
+    // Ranges which contain cells with pending tasks
+    std::vector<Vertex> ranges;
+
+    // Execute pending tasks and merge their results into cells. Spreads which
+    // can not be called concurrently are passed runs of cells (in topological
+    // order) as a single batch, otherwise threads take the next available task
+    // until there are none left
+    auto run = [&]() {
+        if (tasks.empty()) return;
+        if (threads == 1) {
+            std::vector<std::array<std::string, 3>> batch;
+            batch.reserve(tasks.size());
+            for (const auto& task : tasks) {
+                batch.push_back({task.cell->id, task.expression, task.cell->name});
+            }
+            std::vector<std::string> results;
+            try {
+                results = spread_->set_batch(batch);
+            } catch (const std::exception& exc) {
+                results.assign(tasks.size(), exc.what());
+            } catch (...) {
+                results.assign(tasks.size(), "error Unknown exception");
+            }
+            if (results.size() != tasks.size()) {
+                STENCILA_THROW(Exception, "Spread returned wrong number of results for batch");
+            }
+            for (unsigned int index = 0; index < tasks.size(); index++) {
+                tasks[index].type_value = results[index];
+            }
+        } else {
+            std::atomic<unsigned int> next(0);
+            auto work = [&]() {
+                unsigned int index;
+                while ((index = next++) < tasks.size()) {
+                    auto& task = tasks[index];
+                    try {
+                        task.type_value = spread_->set(task.cell->id, task.expression, task.cell->name);
+                    } catch (const std::exception& exc) {
+                        task.type_value = exc.what();
+                    } catch (...) {
+                        task.type_value = "error Unknown exception";
+                    }
+                }
+            };
+            if (tasks.size() > 1) {
+                boost::thread_group group;
+                auto count = std::min<unsigned int>(threads, tasks.size());
+                for (unsigned int thread = 0; thread < count; thread++) {
+                    group.create_thread(work);
+                }
+                group.join_all();
+            } else {
+                work();
+            }
+        }
 
-        // Execute each requirement (amongst changed cells)
-        for (auto id : cells_requirements) {
-            Cell& cell = Sheet::cell(id);
-            spread_->execute(cell.expression);
+        // Merge results back into cells. Values are compared using their hashes
+        // rather than copying and comparing (potentially large) value strings
+        for (auto& task : tasks) {
+            Cell& cell = *task.cell;
+            auto hash = cell.hash;
+            auto space = task.type_value.find(" ");
+            cell.type = task.type_value.substr(0, space);
+            cell.value = task.type_value.substr(space+1);
+            cell.rehash();
+            // Has there been a change in value? Changed cells are always returned
+            // (e.g. their source may have changed) but their successors only need
+            // to be executed if their value has changed
+            if (cell.hash != hash) {
+                updated[task.vertex] = true;
+                updated_cell(cell);
+            } else if (changed[task.vertex]) {
+                updated_cell(cell);
+            }
+            pending[task.vertex] = false;
         }
+        tasks.clear();
+
+        // A range has been updated if any of the cells within it have
+        for (auto vertex : ranges) {
+            boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+            for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                if (updated[boost::source(*edge_iter, graph_)]) {
+                    updated[vertex] = true;
+                    break;
+                }
+            }
+            pending[vertex] = false;
+        }
+        ranges.clear();
+    };
 
-        // Iterate through order and re-execute any cell that has changed itself
-        // or has predecessors that have changed 
-        std::vector<std::string> cells_updated;
-        for (auto id : order_) {
+    // Iterate through levels and re-execute any cell that has changed itself
+    // or has predecessors whose values have changed. Tasks are accumulated so
+    // that they can be run as a batch, or concurrently, and are only run when the
+    // result of one of them is needed to determine if a cell needs to be executed
+    // (or at the end of each level when executing concurrently).
+    // When notifying, results are wanted as soon as possible so the size of
+    // batches is limited.
+    unsigned int batch = notify ? 100 : std::numeric_limits<unsigned int>::max();
+    for (unsigned int level = 0; level < antichains.size(); level++) {
+        const auto& antichain = antichains[level];
+        for (unsigned int index = 0; index < antichain.size(); index++) {
+            // If a subsequent update has been started then stop, recording the cells
+            // that have not been executed so that it can execute them
+            if (generation != updates_) {
+                for (const auto& task : tasks) {
+                    stale_.insert(task.cell->id);
+                }
+                tasks.clear();
+                // Only the remaining cells which have changed themselves, or which have a
+                // predecessor whose value has been updated, need to be recorded: the subsequent
+                // update executes the successors of those if their values change. In lazy mode
+                // all of them are recorded since stale cells are only executed when needed.
+                auto input_updated = [&](Vertex vertex) {
+                    if (updated[vertex]) return true;
+                    if (not ranges_.count(names[vertex])) return false;
+                    boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+                    for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                        if (updated[boost::source(*edge_iter, graph_)]) return true;
+                    }
+                    return false;
+                };
+                for (; level < antichains.size(); level++, index = 0) {
+                    for (; index < antichains[level].size(); index++) {
+                        auto vertex = antichains[level][index];
+                        const auto& id = names[vertex];
+                        if (ranges_.count(id)) continue;
+                        bool superseded = lazy_ or changed[vertex];
+                        if (not superseded) {
+                            boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+                            for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                                superseded = input_updated(boost::source(*edge_iter, graph_));
+                                if (superseded) break;
+                            }
+                        }
+                        if (superseded) stale_.insert(id);
+                    }
+                }
+                if (cancelled) *cancelled = true;
+                break;
+            }
+
+            auto vertex = antichain[index];
+            const auto& id = names[vertex];
+            // A range has been updated if any of the cells within it have. If any
+            // of those are pending, that is determined when they are run
+            if (ranges_.count(id)) {
+                boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+                for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                    auto member_vertex = boost::source(*edge_iter, graph_);
+                    if (updated[member_vertex]) updated[vertex] = true;
+                    if (pending[member_vertex]) pending[vertex] = true;
+                }
+                if (pending[vertex]) ranges.push_back(vertex);
+                continue;
+            }
             // An id may exist in order_ that is not a cell (e.g. if user enters = G5 when G5 is blank)
             // In that case, we don't need to do anything
-            auto iter = cells_.find(id);
+            auto iter = cells_.find(key(id));
             if(iter == cells_.end()) continue;
             Cell& cell = iter->second;
 
+            // In lazy mode, mark a cell that is not needed as stale rather
+            // than determining if it needs to be executed
+            if (lazy_ and not needed[vertex]) {
+                stale_.insert(id);
+                continue;
+            }
+
+            // Give cells within, or depending upon, a cycle an error rather than
+            // executing them (and clear them from the spread so that any other cells
+            // which depend upon them also get an error)
+            if (errored.size() and errored[vertex]) {
+                if (stale_.size()) stale_.erase(id);
+                auto iter = cyclic.find(vertex);
+                auto hash = cell.hash;
+                cell.type = "error";
+                cell.value = (iter != cyclic.end()) ? iter->second : "Depends upon a cell with a cyclic dependency";
+                cell.rehash();
+                spread_->clear(id, cell.name);
+                updated[vertex] = cell.hash != hash;
+                if (updated[vertex] or changed[vertex]) updated_cell(cell);
+                continue;
+            }
+
             // Does this cell need to be executed
             // Has this cell changed?
-            bool execute = std::find(cells_changed.begin(), cells_changed.end(), id) != cells_changed.end();
+            bool execute = changed[vertex];
             if(not execute) {
-                // Has any of it's immeadiate predecessors been updated?
-                auto vertex = vertices_[id];
+                // Has any of it's immeadiate predecessors been updated? That is
+                // not known for those that are pending so run them first.
                 boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
                 for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
-                    auto predecessor_vertex = boost::source(*edge_iter, graph_);
-                    auto predecessor_id = boost::get(boost::vertex_name, graph_)[predecessor_vertex];
-                    execute = std::find(cells_updated.begin(), cells_updated.end(), predecessor_id) != cells_updated.end();
+                    if (pending[boost::source(*edge_iter, graph_)]) {
+                        run();
+                        break;
+                    }
+                }
+                for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                    execute = updated[boost::source(*edge_iter, graph_)];
                     if (execute) break;
                 }
             }
 
             // If don't need to execute this cell then continue loop
             if(not execute) continue; 
-            
-            // Add to list of cells updated
-            cells_updated.push_back(id);
+            if (stale_.size()) stale_.erase(id);
 
             if(cell.kind == Cell::blank_) {
                 // If the cell source was made blank then clear it 
                 // so that any dependant cells will return an error
+                // (after setting any preceding cells)
+                run();
                 spread_->clear(id);
+                cell.hash = 0;
+                updated[vertex] = true;
             } else if (cell.kind == Cell::cila_) {
-                // Convert source to HTML
-                auto html = Stencil().cila(cell.expression).html();
-                cell.value = html;
+                // Convert source to HTML, using the cache if possible
+                auto iter = cilas_.find(cell.expression);
+                if (iter == cilas_.end()) {
+                    // Limit the size of the cache (e.g. when cells are edited many times)
+                    if (cilas_.size() >= 10000) cilas_.clear();
+                    iter = cilas_.insert({cell.expression, Stencil::cila_html(cell.expression)}).first;
+                }
+                auto hash = cell.hash;
+                cell.value = iter->second;
                 cell.type = "html";
-                updates.push_back(cell);
+                cell.rehash();
+                updated[vertex] = cell.hash != hash;
+                updated_cell(cell);
             } else if (cell.expression.length()) {
-                // Store to detect any changes
-                auto type = cell.type;
-                auto value = cell.value;
-                // Translate and execute
-                auto spread_expr = translate(cell.expression);
-                std::string type_value;
-                try {
-                    type_value = spread_->set(id, spread_expr, cell.name);
-                } catch (const std::exception& exc) {
-                    type_value = exc.what();
-                }
-                auto space = type_value.find(" ");
-                cell.type = type_value.substr(0, space);
-                cell.value = type_value.substr(space+1);
-                // Has there been a change? Note change in kind is not detected here!
-                if (cell.type != type or cell.value != value) {
-                    updates.push_back(cell);
+                // If the cell's value was restored from the cache, and it's inputs are
+                // the same as when it was cached, then it does not need to be executed.
+                // That requires the values of predecessors so run any pending first.
+                if (restored_ and cell.inputs) {
+                    boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+                    for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                        if (pending[boost::source(*edge_iter, graph_)]) {
+                            run();
+                            break;
+                        }
+                    }
+                    auto restore = inputs(cell) == cell.inputs;
+                    cell.inputs = 0;
+                    if (restore) continue;
                 }
+                // Translate here since that uses the sheet
+                pending[vertex] = true;
+                tasks.push_back({vertex, &cell, translation(cell.expression).expression, ""});
+                if (tasks.size() >= batch) run();
             }
         }
-    } catch (...){
-        // Ensure return to current directory even if there is an exception
-        boost::filesystem::current_path(current_path);
-        throw;
-    }
 
-    // Return to the current directory
-    boost::filesystem::current_path(current_path);
+        if (threads > 1) run();
+    }
+    run();
+    // Cached inputs are only valid for the first update after a read
+    restored_ = false;
 
     return updates;
 }
 
+std::size_t Sheet::inputs(const Cell& cell) const {
+    std::size_t hash = 0;
+    boost::hash_combine(hash, cell.expression);
+    boost::hash_combine(hash, cell.name);
+    for (const auto& depend : cell.depends) {
+        auto range = ranges_.find(depend);
+        if (range != ranges_.end()) {
+            // Combine the hashes of the cells within the range, column by column
+            const auto& corners = range->second;
+            for (auto col = corners[1]; col <= corners[3]; col++) {
+                auto iter = cells_.lower_bound(key(corners[0], col));
+                auto end = cells_.upper_bound(key(corners[2], col));
+                for (; iter != end; iter++) {
+                    boost::hash_combine(hash, iter->first);
+                    boost::hash_combine(hash, iter->second.hash);
+                }
+            }
+        } else if (is_id(depend)) {
+            auto iter = cells_.find(key(depend));
+            boost::hash_combine(hash, iter != cells_.end() ? iter->second.hash : 0);
+        }
+    }
+    return hash;
+}
+
 std::vector<Sheet::Cell> Sheet::update(const std::string& id, const std::string& source) {
     Cell cell;
     cell.id = id,
@@ -981,18 +2164,66 @@ Sheet& Sheet::update(void) {
     return *this;
 }
 
+bool Sheet::lazy(void) const {
+    return lazy_;
+}
+
+Sheet& Sheet::lazy(bool lazy) {
+    lazy_ = lazy;
+    return *this;
+}
+
+std::array<unsigned int, 4> Sheet::viewport(void) const {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    return viewport_;
+}
+
+std::vector<Sheet::Cell> Sheet::viewport(unsigned int row1, unsigned int col1, unsigned int row2, unsigned int col2) {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    viewport_ = {{row1, col1, row2, col2}};
+    std::vector<std::string> ids;
+    if (stale_.size()) {
+        for (auto row = row1; row <= row2; row++) {
+            for (auto col = col1; col <= col2; col++) {
+                auto iter = cells_.find(key(row, col));
+                if (iter != cells_.end() and stale_.count(iter->second.id)) {
+                    ids.push_back(iter->second.id);
+                }
+            }
+        }
+    }
+    return compute(ids);
+}
+
+bool Sheet::stale(const std::string& id) const {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    return stale_.count(id);
+}
+
+std::vector<Sheet::Cell> Sheet::compute(const std::vector<std::string>& ids) {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
+    std::vector<Cell> changes;
+    for (const auto& id : ids) {
+        if (stale_.count(id)) changes.push_back(cell(id));
+    }
+    if (changes.empty()) return {};
+    return update(changes, true, nullptr, nullptr, ids);
+}
+
 std::vector<std::string> Sheet::list(void) {
     if (not spread_) STENCILA_THROW(Exception, "No spread attached to this sheet");
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     return split(spread_->list(), ",");
 }
 
 std::string Sheet::content(const std::string& name) {
     if (not spread_) STENCILA_THROW(Exception, "No spread attached to this sheet");
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     return spread_->get(name);
 }
 
 std::vector<std::string> Sheet::depends(const std::string& id) {
-    auto iter = cells_.find(id);
+    auto iter = cells_.find(key(id));
     if (iter == cells_.end()) {
         STENCILA_THROW(Exception, "No cell with id\n  id: "+id);
     }
@@ -1003,6 +2234,194 @@ std::vector<std::string> Sheet::order(void) const {
     return order_;
 }
 
+std::vector<std::vector<std::string>> Sheet::cycles(void) const {
+    auto names = boost::get(boost::vertex_name, graph_);
+    std::vector<std::vector<std::string>> cycles;
+    for (const auto& vertices : cycles_) {
+        std::vector<std::string> ids;
+        for (auto vertex : vertices) {
+            const auto& id = names[vertex];
+            if (is_id(id)) ids.push_back(id);
+        }
+        std::sort(ids.begin(), ids.end(), [](const std::string& a, const std::string& b) {
+            return key(a) < key(b);
+        });
+        cycles.push_back(ids);
+    }
+    return cycles;
+}
+
+Sheet::Vertex Sheet::vertex(const std::string& id) {
+    auto iter = vertices_.find(id);
+    if (iter != vertices_.end()) return iter->second;
+
+    // For a range, get the vertices of the existing cells within it
+    // (before adding its own, so that they precede it in the order)
+    std::vector<Vertex> cells;
+    std::array<unsigned int, 4> corners;
+    auto colon = id.find(':');
+    if (colon != std::string::npos) {
+        auto from = index(id.substr(0, colon));
+        auto to = index(id.substr(colon + 1));
+        corners = {from[0], from[1], to[0], to[1]};
+        for (auto col = from[1]; col <= to[1]; col++) {
+            auto end = cells_.upper_bound(key(to[0], col));
+            for (auto iter = cells_.lower_bound(key(from[0], col)); iter != end; iter++) {
+                cells.push_back(vertex(iter->second.id));
+            }
+        }
+    }
+
+    auto vertex = boost::add_vertex(id, graph_);
+    vertices_[id] = vertex;
+    positions_.push_back(order_.size());
+    order_.push_back(id);
+
+    if (colon != std::string::npos) {
+        for (auto cell : cells) boost::add_edge(cell, vertex, graph_);
+        ranges_[id] = corners;
+        for (auto col = corners[1]; col <= corners[3]; col++) range_columns_[col].push_back(id);
+        invalidate();
+    }
+    return vertex;
+}
+
+namespace {
+
+/**
+ * Edge filter for a dependency graph which excludes edges within
+ * a strongly connected component (i.e. within a cycle)
+ */
+template<class Graph>
+struct AcyclicEdges {
+    const Graph* graph = nullptr;
+    const std::vector<unsigned int>* components = nullptr;
+
+    template<class Edge>
+    bool operator()(const Edge& edge) const {
+        return (*components)[boost::source(edge, *graph)] != (*components)[boost::target(edge, *graph)];
+    }
+};
+
+}
+
+void Sheet::sort(void) {
+    cycles_.clear();
+    std::vector<Vertex> vertices;
+    try {
+        topological_sort(graph_, std::back_inserter(vertices));
+    }
+    catch (const std::invalid_argument& ) {
+        // Find the cycles: strongly connected components (using Tarjan's algorithm) with more
+        // than one vertex, or with a vertex that depends upon itself
+        std::vector<unsigned int> components(boost::num_vertices(graph_));
+        auto count = boost::strong_components(
+            graph_, boost::make_iterator_property_map(components.begin(), boost::get(boost::vertex_index, graph_))
+        );
+        std::vector<std::vector<Vertex>> members(count);
+        for (Vertex vertex = 0; vertex < components.size(); vertex++) {
+            members[components[vertex]].push_back(vertex);
+        }
+        for (auto& vertices : members) {
+            if (vertices.size() > 1 or boost::edge(vertices[0], vertices[0], graph_).second) {
+                cycles_.push_back(std::move(vertices));
+            }
+        }
+
+        // Without the edges within cycles the graph is acyclic
+        AcyclicEdges<Graph> filter;
+        filter.graph = &graph_;
+        filter.components = &components;
+        boost::filtered_graph<Graph, AcyclicEdges<Graph>> acyclic(graph_, filter);
+        vertices.clear();
+        topological_sort(acyclic, std::back_inserter(vertices));
+    }
+    reverse(vertices.begin(), vertices.end());
+
+    auto names = boost::get(boost::vertex_name, graph_);
+    order_.resize(vertices.size());
+    positions_.resize(vertices.size());
+    for (unsigned int position = 0; position < vertices.size(); position++) {
+        auto vertex = vertices[position];
+        order_[position] = names[vertex];
+        positions_[vertex] = position;
+    }
+    // While there are cycles the order is not consistent with the whole graph
+    // so continue to do a full sort (which will detect when they are broken)
+    ordered_ = cycles_.empty();
+}
+
+bool Sheet::reorder(Vertex from, Vertex to) {
+    if (from == to) return false;
+
+    // If `from` already comes before `to` then the order remains valid
+    auto lower = positions_[to];
+    auto upper = positions_[from];
+    if (lower > upper) return true;
+
+    // Forward search from `to` for vertices before `from` in the order.
+    // Reaching `from` means the edge has closed a cycle.
+    std::vector<Vertex> forward;
+    // Only the affected region is searched so a `set`, rather than a
+    // per-vertex array, is used to record visited vertices
+    std::vector<Vertex> stack = {to};
+    std::set<Vertex> visited = {to};
+    while (stack.size()) {
+        auto vertex = stack.back();
+        stack.pop_back();
+        forward.push_back(vertex);
+        boost::graph_traits<Graph>::out_edge_iterator edge_iter, edge_end;
+        for (boost::tie(edge_iter,edge_end) = out_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+            auto successor = boost::target(*edge_iter, graph_);
+            if (successor == from) return false;
+            if (positions_[successor] < upper and visited.insert(successor).second) {
+                stack.push_back(successor);
+            }
+        }
+    }
+
+    // Backward search from `from` for vertices after `to` in the order
+    std::vector<Vertex> backward;
+    stack = {from};
+    visited.insert(from);
+    while (stack.size()) {
+        auto vertex = stack.back();
+        stack.pop_back();
+        backward.push_back(vertex);
+        boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+        for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+            auto predecessor = boost::source(*edge_iter, graph_);
+            if (positions_[predecessor] > lower and visited.insert(predecessor).second) {
+                stack.push_back(predecessor);
+            }
+        }
+    }
+
+    // Reallocate the positions held by both sets so that all of the
+    // backward set come before all of the forward set, each retaining
+    // their relative order
+    auto by_position = [this](Vertex a, Vertex b) {
+        return positions_[a] < positions_[b];
+    };
+    std::sort(forward.begin(), forward.end(), by_position);
+    std::sort(backward.begin(), backward.end(), by_position);
+    std::vector<unsigned int> pool;
+    for (auto vertex : backward) pool.push_back(positions_[vertex]);
+    for (auto vertex : forward) pool.push_back(positions_[vertex]);
+    std::sort(pool.begin(), pool.end());
+
+    auto names = boost::get(boost::vertex_name, graph_);
+    auto index = 0u;
+    for (auto vertices : {&backward, &forward}) {
+        for (auto vertex : *vertices) {
+            auto position = pool[index++];
+            positions_[vertex] = position;
+            order_[position] = names[vertex];
+        }
+    }
+    return true;
+}
+
 
 class SheetGraphvizPropertyWriter {
  public:
@@ -1012,7 +2431,11 @@ class SheetGraphvizPropertyWriter {
     template <class VertexOrEdge>
     void operator()(std::ostream& out, const VertexOrEdge& v) const {
         auto id = boost::get(boost::vertex_name, sheet_->graph_)[v];
-        const auto& cell = sheet_->cells_.at(id);
+        if (sheet_->ranges_.count(id)) {
+            out << "[label=\"" << id << "\", shape=\"box3d\"]";
+            return;
+        }
+        const auto& cell = sheet_->cells_.at(Sheet::key(id));
 
         out << "[";
 
@@ -1079,37 +2502,89 @@ void Sheet::graphviz(const std::string& filepath, bool image) const {
     }
 }
 
-std::vector<std::string> Sheet::predecessors(const std::string& id) {
-    auto iter = std::find(order_.begin(), order_.end(), id);
-    if (iter == order_.end()) return {};
-    return std::vector<std::string>(order_.begin(), iter);
+std::vector<std::string> Sheet::predecessors(const std::string& id, unsigned int depth) {
+    return related(id, depth, false);
 }
 
-std::vector<std::string> Sheet::successors(const std::string& id) {
-    auto iter = std::find(order_.begin(), order_.end(), id);
-    if (iter == order_.end()) return {};
-    if (iter == order_.end()-1) return {};
-    return std::vector<std::string>(iter+1, order_.end());
+std::vector<std::string> Sheet::successors(const std::string& id, unsigned int depth) {
+    return related(id, depth, true);
 }
 
-template<class Predecessors>
-class test_bfs_visitor : public boost::default_bfs_visitor {
-  public:
-    Predecessors& predecessors;
+std::vector<std::string> Sheet::related(const std::string& id, unsigned int depth, bool successors) {
+    auto iter = vertices_.find(id);
+    if (iter == vertices_.end()) return {};
+    auto start = iter->second;
 
-    test_bfs_visitor(Predecessors& predecessors_):
-        predecessors(predecessors_){}
+    // Unlimited queries are cached until the graph changes
+    auto& closures = closures_[successors];
+    if (depth == 0) {
+        auto closure = closures.find(start);
+        if (closure != closures.end()) return closure->second;
+    }
 
-    template <typename Vertex, typename Graph>
-    void discover_vertex(const Vertex& v, Graph& g) {
-      predecessors.push_back(v);
+    // Breadth first search of inward (predecessors) or outward (successors) edges
+    // recording the depth at which each vertex is first reached. Ranges are not 
+    // a level of dependency themselves so vertices reached via them are given the
+    // range's depth and put at the front of the queue.
+    auto names = boost::get(boost::vertex_name, graph_);
+    std::map<Vertex, unsigned int> depths;
+    std::deque<Vertex> queue;
+    depths[start] = 0;
+    queue.push_back(start);
+    auto visit = [&](Vertex vertex, unsigned int from) {
+        bool range = ranges_.count(names[vertex]);
+        auto level = range ? from : from + 1;
+        auto found = depths.find(vertex);
+        if (found == depths.end() or level < found->second) {
+            depths[vertex] = level;
+            if (range) queue.push_front(vertex);
+            else queue.push_back(vertex);
+        }
+    };
+    while (queue.size()) {
+        auto vertex = queue.front();
+        queue.pop_front();
+        auto level = depths[vertex];
+        if (depth and level >= depth) continue;
+        if (successors) {
+            boost::graph_traits<Graph>::out_edge_iterator edge_iter, edge_end;
+            for (boost::tie(edge_iter,edge_end) = out_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                visit(boost::target(*edge_iter, graph_), level);
+            }
+        } else {
+            boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+            for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                visit(boost::source(*edge_iter, graph_), level);
+            }
+        }
     }
-};
 
-Json::Document Sheet::test(void) const {
-    // Reverse graph for predecessor analysis
-    auto reversed_graph = boost::make_reverse_graph(graph_);
+    // Cells (not ranges) in topological order
+    std::vector<Vertex> vertices;
+    for (const auto& item : depths) {
+        if (item.first != start and not ranges_.count(names[item.first])) {
+            vertices.push_back(item.first);
+        }
+    }
+    std::sort(vertices.begin(), vertices.end(), [this](Vertex a, Vertex b) {
+        return positions_[a] < positions_[b];
+    });
+    std::vector<std::string> ids;
+    ids.reserve(vertices.size());
+    for (auto vertex : vertices) ids.push_back(names[vertex]);
+
+    if (depth == 0) closures[start] = ids;
+    return ids;
+}
 
+void Sheet::invalidate(void) {
+    covered_ = -1;
+    closures_[0].clear();
+    closures_[1].clear();
+}
+
+Json::Document Sheet::test(void) const {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     Json::Document results;
     int cells = 0;
     int expressions = 0;
@@ -1117,9 +2592,7 @@ Json::Document Sheet::test(void) const {
     int passes = 0;
     int fails = 0;
     int errors = 0;
-    int covered = 0;
     for(const auto& iter : cells_) {
-        const auto& id = iter.first;
         const auto& cell = iter.second;
         cells++;
         if (cell.kind == Cell::test_) {
@@ -1133,45 +2606,80 @@ Json::Document Sheet::test(void) const {
             else if (cell.type == "error") {
                 errors++;
             }
+        } else if (cell.kind == Cell::expression_) {
+            expressions++;
+        }
+    }
 
-            // Count test predecessors that are expressions
-            std::vector<Vertex> predecessors;
-            test_bfs_visitor<decltype(predecessors)> visitor(predecessors);
-            boost::breadth_first_search(
-                reversed_graph,
-                vertices_.at(id),
-                boost::visitor(visitor)
-            );
-            for(const auto& predecessor_vertex : predecessors) {
-                auto predecessor_id = boost::get(boost::vertex_name, reversed_graph)[predecessor_vertex];
-                if (predecessor_id == id) continue;
-                const auto& predecessor = cells_.at(predecessor_id);
-                if (predecessor.kind == Cell::expression_) {
+    // Count expressions that are predecessors of at least one test. Rather than searching
+    // from each test cell, all vertices from which a test can be reached are found in a
+    // single traversal of inward edges from all test cells (so each vertex and edge is visited
+    // at most once). The count only depends upon the dependency graph and the kinds of cells so
+    // it is cached until either of those change.
+    if (covered_ < 0) {
+        std::vector<bool> visited(boost::num_vertices(graph_), false);
+        std::vector<Vertex> stack;
+        for(const auto& iter : cells_) {
+            const auto& cell = iter.second;
+            if (cell.kind == Cell::test_) {
+                auto vertex = vertices_.find(cell.id);
+                if (vertex != vertices_.end() and not visited[vertex->second]) {
+                    visited[vertex->second] = true;
+                    stack.push_back(vertex->second);
+                }
+            }
+        }
+        auto names = boost::get(boost::vertex_name, graph_);
+        int covered = 0;
+        while (stack.size()) {
+            auto vertex = stack.back();
+            stack.pop_back();
+            const auto& id = names[vertex];
+            if (not ranges_.count(id)) {
+                auto iter = cells_.find(key(id));
+                if (iter != cells_.end() and iter->second.kind == Cell::expression_) {
                     covered++;
                 }
             }
-        } else if (cell.kind == Cell::expression_) {
-            expressions++;
+            boost::graph_traits<Graph>::in_edge_iterator edge_iter, edge_end;
+            for (boost::tie(edge_iter,edge_end) = in_edges(vertex, graph_); edge_iter != edge_end; ++edge_iter) {
+                auto predecessor = boost::source(*edge_iter, graph_);
+                if (not visited[predecessor]) {
+                    visited[predecessor] = true;
+                    stack.push_back(predecessor);
+                }
+            }
         }
+        covered_ = covered;
     }
+
     results.append("cells", cells);
     results.append("expressions", expressions);
     results.append("tests", tests);
     results.append("passes", passes);
     results.append("fails", fails);
     results.append("errors", errors);
-    results.append("covered", covered);
-    results.append("coverage", expressions>0?covered/double(expressions):0);
+    results.append("covered", covered_);
+    results.append("coverage", expressions>0?covered_/double(expressions):0);
     return results;
 }
 
 Sheet& Sheet::clear(void) {
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     cells_.clear();
     names_.clear();
     vertices_.clear(); // Container pointers to graph_ vertices, so clear first!
     graph_.clear();
     order_.clear();
+    positions_.clear();
+    ranges_.clear();
+    range_columns_.clear();
+    invalidate();
+    translations_.clear();
+    stale_.clear();
+    cycles_.clear();
     prepared_ = false;
+    ordered_ = false;
     if (spread_) {
         spread_->clear("");
     }
@@ -1179,6 +2687,8 @@ Sheet& Sheet::clear(void) {
 }
 
 std::vector<std::string> Sheet::functions(void) const {
+    // The spread is also used by any asynchronous update
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     if (spread_) {
         return spread_->functions();
     } else {
@@ -1188,6 +2698,7 @@ std::vector<std::string> Sheet::functions(void) const {
 
 Function Sheet::function(const std::string& name) const {
     if (not spread_) STENCILA_THROW(Exception, "No spread attached to this sheet");
+    boost::lock_guard<boost::recursive_mutex> lock(updating_);
     return spread_->function(name);
 }
 
@@ -1236,69 +2747,135 @@ std::string Sheet::Cell::source(void) const {
     }
 }
 
-Sheet::Cell& Sheet::Cell::source(const std::string& source) {
-    auto source_clean = source;
-    boost::replace_all(source_clean, "\t", " ");
+namespace {
+
+/**
+ * Character classes used when parsing cell sources (equivalent to
+ * those for the "C" locale but without the overhead of locale lookups)
+ */
+inline bool source_space(char c) {
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r' or c == '\f' or c == '\v';
+}
+
+inline bool source_digit(char c) {
+    return c >= '0' and c <= '9';
+}
+
+inline bool source_word(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or source_digit(c) or c == '_';
+}
+
+/**
+ * Does a (trimmed) source match a number e.g. `-3.14`?
+ */
+bool source_number(const char* begin, const char* end) {
+    if (*begin == '-' or *begin == '+') begin++;
+    const char* digits = begin;
+    while (begin != end and source_digit(*begin)) begin++;
+    if (begin == end) return begin != digits;
+    if (*begin != '.') return false;
+    begin++;
+    if (begin == end) return false;
+    while (begin != end and source_digit(*begin)) begin++;
+    return begin == end;
+}
+
+/**
+ * Does a (trimmed) source match a quoted string e.g. `"foo"` or `'bar'`?
+ *
+ * Within either, escaped characters are allowed but unescaped double quotes are not
+ */
+bool source_string(const char* begin, const char* end) {
+    auto length = end - begin;
+    if (length < 2 or (*begin != '"' and *begin != '\'') or *(end - 1) != *begin) return false;
+    for (const char* iter = begin + 1; iter < end - 1; iter++) {
+        if (*iter == '\\') {
+            iter++;
+            if (iter == end - 1) return false;
+        } else if (*iter == '"') {
+            return false;
+        }
+    }
+    return true;
+}
 
-    // `\s*` at ends allows for leading and trailing spaces or newlines
-    // Commented quotes below are to stop SublimeText's string formatting on subsequent line
-    static const boost::regex blank_regex(R"(^\s*$)");
-    
-    static const std::string name_re = R"(^\s*([a-z]\w*)? *)";
-    static const std::string expr_re = R"( *(.+?)\s*$)";
-    static const boost::regex expression_regex(name_re+"\\="+expr_re);
-    static const boost::regex mapping_regex(name_re+"\\:"+expr_re);
-    static const boost::regex requirement_regex(name_re+"\\^"+expr_re);
-    static const boost::regex manual_regex(name_re+"\\|"+expr_re);
-    static const boost::regex test_regex(name_re+"\\?"+expr_re);
-    static const boost::regex visualization_regex(name_re+"\\~"+expr_re);
-    static const boost::regex cila_regex(name_re+"\\_"+expr_re);
-
-    static const boost::regex number_regex(R"(^\s*([-+]?[0-9]*\.?[0-9]+)\s*$)");
-    static const boost::regex dq_string_regex(R"(^\s*("(?:[^"\\]|\\.)*")\s*$)"); // "
-    static const boost::regex sq_string_regex(R"(^\s*('(?:[^"\\]|\\.)*')\s*$)"); // '
-
-    boost::smatch match;
-    if (boost::regex_match(source_clean, match, blank_regex)){
+}
+
+Sheet::Cell& Sheet::Cell::source(const std::string& source) {
+    // A single pass over the source, with tabs treated as spaces, to determine
+    // the kind, name and expression of the cell
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+
+    // Leading and trailing whitespace (including newlines) is insignificant
+    const char* first = begin;
+    while (first != end and source_space(*first)) first++;
+    if (first == end) {
         kind = Cell::blank_;
-    } else if (boost::regex_match(source_clean, match, expression_regex)) {
-        kind = Cell::expression_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, mapping_regex)) {
-        kind = Cell::mapping_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, requirement_regex)) {
-        kind = Cell::requirement_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, manual_regex)) {
-        kind = Cell::manual_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, test_regex)) {
-        kind = Cell::test_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, visualization_regex)) {
-        kind = Cell::visualization_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, cila_regex)) {
-        kind = Cell::cila_;
-        name = match.str(1);
-        expression = match.str(2);
-    } else if (boost::regex_match(source_clean, match, number_regex)) {
+        return *this;
+    }
+    const char* last = end;
+    while (source_space(*(last - 1))) last--;
+
+    // Directives, with an optional name, e.g. `= 6*7`, `foo : matrix`. The directive
+    // must be followed by at least one character.
+    auto directive = [&](Kind which, const char* name_end, const char* op) {
+        const char* after = op + 1;
+        if (after == end) return false;
+        const char* expr = after;
+        while (expr != end and (*expr == ' ' or *expr == '\t')) expr++;
+        kind = which;
+        name.assign(first, name_end);
+        if (expr < last) {
+            expression.assign(expr, last);
+            std::replace(expression.begin(), expression.end(), '\t', ' ');
+        } else if (expr != end) {
+            // Only whitespace so expression is the first character of it
+            expression.assign(expr, expr + 1);
+        } else {
+            // Only spaces so expression is a single space
+            expression.assign(" ");
+        }
+        return true;
+    };
+    const char* iter = first;
+    if (*iter >= 'a' and *iter <= 'z') {
+        iter++;
+        while (iter != end and source_word(*iter)) iter++;
+    }
+    const char* name_end = iter;
+    while (iter != end and (*iter == ' ' or *iter == '\t')) iter++;
+    if (iter != end) {
+        Kind which = Cell::blank_;
+        switch (*iter) {
+            case '=': which = Cell::expression_; break;
+            case ':': which = Cell::mapping_; break;
+            case '^': which = Cell::requirement_; break;
+            case '|': which = Cell::manual_; break;
+            case '?': which = Cell::test_; break;
+            case '~': which = Cell::visualization_; break;
+            case '_': which = Cell::cila_; break;
+        }
+        if (which != Cell::blank_ and directive(which, name_end, iter)) return *this;
+    }
+    // The cila directive is also a word character so may be within
+    // what would otherwise be a name (e.g. `a_b` is name `a` and expression `b`)
+    for (auto under = name_end; under-- > first + 1;) {
+        if (*under == '_' and directive(Cell::cila_, under, under)) return *this;
+    }
+
+    if (source_number(first, last)) {
         kind = Cell::number_;
-        expression = match.str(1);
-    } else if (boost::regex_match(source_clean, match, dq_string_regex) or
-               boost::regex_match(source_clean, match, sq_string_regex)) {
+        expression.assign(first, last);
+    } else if (source_string(first, last)) {
         kind = Cell::string_;
-        expression = match.str(1);
+        expression.assign(first, last);
+        std::replace(expression.begin(), expression.end(), '\t', ' ');
     } else {
         kind = Cell::text_;
-        expression = "\"" + source + "\"";
+        expression.assign(1, '"');
+        expression.append(source);
+        expression.push_back('"');
     }
 
     return *this;
@@ -1327,4 +2904,10 @@ Sheet::Cell& Sheet::Cell::display(const std::string& display) {
     return *this;
 }
 
+Sheet::Cell& Sheet::Cell::rehash(void) {
+    hash = std::hash<std::string>()(type);
+    boost::hash_combine(hash, value);
+    return *this;
+}
+
 }  // namespace Stencila
@@ -1,12 +1,18 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
-#include <boost/regex.hpp>
 #include <boost/graph/adjacency_list.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <stencila/component.hpp>
 #include <stencila/function.hpp>
@@ -133,12 +139,39 @@ class Sheet : public Component {
     Sheet& initialise(const std::string& from);
 
     /**
-     * Generate a HTML table for this sheet
+     * Generate a HTML table for this sheet, or a window of it
+     *
+     * Only the cells within the window are rendered so that the size of the table
+     * does not depend upon the size of the sheet. The `data-rows` and `data-cols` attributes of
+     * the table give the extent of the sheet so that clients can scroll the window (e.g. using `tile()`).
+     *
+     * @param  rows Number of rows in the window (if zero then a default based on the sheet's extent)
+     * @param  cols Number of columns in the window (if zero then a default based on the sheet's extent)
+     * @param  row  Index of the first row in the window (0-based)
+     * @param  col  Index of the first column in the window (0-based)
      */
-    Html::Fragment html_table(unsigned int rows = 0, unsigned int cols = 0) const;
+    Html::Fragment html_table(unsigned int rows = 0, unsigned int cols = 0, unsigned int row = 0, unsigned int col = 0) const;
+
+    /**
+     * Get a tile (a window) of cells
+     *
+     * Used by clients for virtual scrolling of large sheets. Only cells that have content
+     * are included in the returned JSON object, e.g.
+     *
+     *     {"row":0,"col":0,"rows":50,"cols":26,"cells":[{"id":"A1","kind":"num","type":"real","value":"42","display":"cli"},...]}
+     *
+     * @param  row  Index of the first row in the tile (0-based)
+     * @param  col  Index of the first column in the tile (0-based)
+     * @param  rows Number of rows in the tile
+     * @param  cols Number of columns in the tile
+     */
+    Json::Document tile(unsigned int row, unsigned int col, unsigned int rows, unsigned int cols) const;
 
     /**
      * Load this sheet from an input stream
+     *
+     * Formats are `tsv` (a grid of cell sources) and `bin` (a binary snapshot
+     * of the sheet's cells, including their values).
      * 
      * @param  stream Input stream
      */
@@ -203,6 +236,9 @@ class Sheet : public Component {
 
     /**
      * Take a snapshot of this sheet
+     *
+     * As well as writing the sheet, a binary snapshot of its cells is
+     * written to `out/sheet.bin` for a fast `restore()`.
      */
     Sheet& store(void);
 
@@ -410,6 +446,30 @@ class Sheet : public Component {
          */
         std::string value;
 
+        /**
+         * Hash of the type and value of this cell
+         *
+         * Used in `update()` to cheaply determine whether executing a cell actually
+         * changed its value (and so whether its successors need to be executed) without
+         * having to copy and compare value strings. Zero if the cell has no value.
+         */
+        std::size_t hash = 0;
+
+        /**
+         * Recalculate the hash of this cell from its type and value
+         */
+        Cell& rehash(void);
+
+        /**
+         * Hash of the inputs (expression and the values of dependencies) when 
+         * this cell was last executed
+         *
+         * Read from the sheet's evaluation cache and used in the first `update()`
+         * after `read()` to restore, rather than execute, cells whose inputs are 
+         * unchanged. Zero if not known.
+         */
+        std::size_t inputs = 0;
+
         /**
          * Get the source for this cell
          */
@@ -516,12 +576,30 @@ class Sheet : public Component {
     static std::string identify(unsigned int row, unsigned int col);
 
     /**
-     * Regular expression used for identifiying and parsing cell IDs
+     * Generate an identifier for a cell in R1C1 notation
+     *
+     * e.g. `R45C46` for the cell `AT45`
      */
-    static boost::regex id_regex;
+    static std::string identify_r1c1(unsigned int row, unsigned int col);
+
+    /**
+     * Scan a cell identifier for its row and column indices
+     *
+     * Hand written, rather than using a regular expression, and allocation free because
+     * identifiers are parsed in hot paths (e.g. dependency analysis and cell lookup).
+     *
+     * @param  begin Pointer to the first character of the identifier
+     * @param  end   Pointer to one past the last character of the identifier
+     * @param  row   Set to the 0-based row index
+     * @param  col   Set to the 0-based column index
+     * @return       Is the identifier valid?
+     */
+    static bool scan_id(const char* begin, const char* end, unsigned int& row, unsigned int& col);
 
     /**
      * Is a string a valid cell ID?
+     *
+     * Only A1 notation is used for ids of cells (and their variables in the spread)
      */
     static bool is_id(const std::string& id);
 
@@ -541,9 +619,19 @@ class Sheet : public Component {
 
     /**
      * Generate the row and column index from a cell identifier
+     *
+     * Only A1 notation (e.g. `C2`) is accepted, as for `is_id()`, so that each
+     * cell has only one identifier. Use `index_r1c1()` for R1C1 notation.
      */
     static std::array<unsigned int, 2> index(const std::string& id);
 
+    /**
+     * Generate the row and column index from a cell identifier in R1C1 notation
+     *
+     * The inverse of `identify_r1c1` e.g. `R2C3` gives the indices of `C2`
+     */
+    static std::array<unsigned int, 2> index_r1c1(const std::string& id);
+
     /**
      * Create a list of cell IDs that interpolate between the
      * upper left and bottom right corners.
@@ -581,6 +669,11 @@ class Sheet : public Component {
      *   cell sequence `:` e.g. A1:A3 -> c(A1,A2,A3)
      *   cell union    '&' e.g. A1&A2:A3&A4 -> c(A1,A2,A3,A4)
      *
+     * Where the spread supports ranges (see `Spread::range`) a cell sequence is translated
+     * into a range expression having only the corner coordinates (e.g. A1:A3 -> .range(0,0,2,0))
+     * rather than being expanded into a list of every cell within it. Range expressions
+     * are only valid within the spread so `standalone` prevents their use (e.g. when dumping a script).
+     *
      * Regexes are used to ensure this translation is only done for operators
      * applied to cell ids. 
      * 
@@ -588,8 +681,12 @@ class Sheet : public Component {
      * in Excel and Libre Office a comma is used. Commas are more easily confused 
      * with function argument delimiters. The ampersand, is used in some languages
      * for set union (e.g. Python) although in R '&' is the logical "and" operator. 
+     *
+     * @param expression Sheet expression
+     * @param ranges     If not null, the ranges (e.g. `A1:A3`) translated into range expressions are appended
+     * @param standalone Expand cell sequences into lists of cells, even if the spread supports ranges?
      */
-    std::string translate(const std::string& expression);
+    std::string translate(const std::string& expression, std::vector<std::string>* ranges = nullptr, bool standalone = false);
 
     /**
      * Evaluate a sheet expression within the attached spread
@@ -602,16 +699,42 @@ class Sheet : public Component {
      * This method parses the new source and will then update the cells' corresponding
      * variable/s (both id and optional name) within the spread environment. Because of
      * interdependencies between cells this method is designed to take batches of cell updates,
-     * analyse the dependency graph and then execute each cell expression. It returns a map of cells
-     * whose `type` or `value` has changed (some cells may have changed in the spread but if their string
-     * value has not changed then they will not be returned in the map)
+     * analyse the dependency graph and then execute each cell expression. It returns the cells
+     * in `changes` (whether or not their `type` or `value` changed) along with any successors
+     * whose `type` or `value` changed.
+     *
+     * Successors are only executed if the value of one of their predecessors has changed (early cutoff).
+     * Values are compared using a hash of each cell's `type` and `value` rather than the strings
+     * themselves.
+     *
+     * Starting an update cancels any update already in progress (e.g. one started by
+     * `update_async()`). Cells which that update had not yet executed are executed
+     * as part of this one.
      *
      * @param changes Map of cell IDs and their sources
      * @param execute Should cell expressions be executed inthe context?
-     * @return List of IDs of the cells that have changed (including updated cells and their successors)
+     * @return List of the cells that have changed (including updated cells and their successors)
      */
     std::vector<Cell> update(const std::vector<Cell>& changes, bool execute = true);
 
+    /**
+     * Update the sheet given changes to cells, asynchronously
+     *
+     * Does the same as `update(changes)` but on a worker thread, calling `notify` with each cell
+     * that has changed as soon as it has been computed and `done` when the update has finished. 
+     * `done` is called with `true` if the update was cancelled by a subsequent one and with the
+     * message of any exception (e.g. due to a cyclic dependency).
+     *
+     * @param changes Map of cell IDs and their sources
+     * @param notify Function called with each changed cell
+     * @param done Function called when the update has finished or been cancelled
+     */
+    Sheet& update_async(
+        const std::vector<Cell>& changes,
+        const std::function<void(const Cell&)>& notify,
+        const std::function<void(bool, const std::string&)>& done = nullptr
+    );
+
     /**
      * Update a single cell with new source
      * 
@@ -629,6 +752,61 @@ class Sheet : public Component {
      */
     Sheet& update(void);
 
+    /**
+     * Is this sheet in lazy evaluation mode?
+     */
+    bool lazy(void) const;
+
+    /**
+     * Set lazy evaluation mode
+     *
+     * In lazy mode, an update only executes the cells which are within the viewport, or which
+     * those cells depend upon. Other cells that would have been executed are marked as stale
+     * and are executed when they are in the viewport or requested (e.g. using `compute()`).
+     * When lazy mode is turned off, the next update executes all stale cells.
+     *
+     * @param lazy Turn lazy mode on or off
+     */
+    Sheet& lazy(bool lazy);
+
+    /**
+     * Get the viewport (row1, col1, row2, col2) of this sheet
+     *
+     * Defaults to the smallest region displayed by `html_table()`
+     */
+    std::array<unsigned int, 4> viewport(void) const;
+
+    /**
+     * Set the viewport of this sheet, executing any stale cells which
+     * come into view
+     *
+     * @param  row1 Row index of the upper left corner (0-based)
+     * @param  col1 Column index of the upper left corner (0-based)
+     * @param  row2 Row index of the lower right corner (0-based)
+     * @param  col2 Column index of the lower right corner (0-based)
+     * @return List of cells that have changed
+     */
+    std::vector<Cell> viewport(unsigned int row1, unsigned int col1, unsigned int row2, unsigned int col2);
+
+    /**
+     * Is a cell stale? i.e. would it have been executed by an update but was not because
+     * the sheet is in lazy mode (or the update was cancelled)
+     *
+     * @param id ID of the cell
+     */
+    bool stale(const std::string& id) const;
+
+    /**
+     * Execute stale cells on demand
+     *
+     * Executes those of the cells which are stale along with any stale
+     * cells that they depend upon.
+     *
+     * @param ids IDs of the cells
+     * @return List of cells that have changed
+     */
+    std::vector<Cell> compute(const std::vector<std::string>& ids);
+
     /**
      * List the names of variables within the attached spread
      *
@@ -652,9 +830,22 @@ class Sheet : public Component {
 
     /**
      * Get the topological sort order for the cells in this sheet
+     *
+     * If there are cyclic dependencies, the order ignores the dependencies
+     * between the cells within each cycle.
      */
     std::vector<std::string> order(void) const;
 
+    /**
+     * Get the cyclic dependencies in this sheet
+     *
+     * Cells within a cycle, and the cells which depend upon them, are given an error
+     * value when the sheet is updated. Other cells are updated as normal.
+     *
+     * @return The IDs of the cells in each cycle
+     */
+    std::vector<std::vector<std::string>> cycles(void) const;
+
     /**
      * Generate a Graphviz `dot` file of the dependency graph for this sheet
      *
@@ -664,18 +855,24 @@ class Sheet : public Component {
     void graphviz(const std::string& path = "", bool image = true) const;
 
     /**
-     * Get all predecessor cells for a cell
+     * Get all predecessor cells for a cell (i.e. the cells it depends upon, directly
+     * or indirectly)
      *
-     * @param id ID of the cell
+     * @param id    ID of the cell
+     * @param depth Maximum number of dependency levels (0 for no limit)
+     * @return      IDs of the cells in topological order
      */
-    std::vector<std::string> predecessors(const std::string& id);
+    std::vector<std::string> predecessors(const std::string& id, unsigned int depth = 0);
 
     /**
-     * Get all successor cells for a cell
+     * Get all successor cells for a cell (i.e. the cells which depend upon it, directly
+     * or indirectly)
      *
-     * @param id ID of the cell
+     * @param id    ID of the cell
+     * @param depth Maximum number of dependency levels (0 for no limit)
+     * @return      IDs of the cells in topological order
      */
-    std::vector<std::string> successors(const std::string& id);
+    std::vector<std::string> successors(const std::string& id, unsigned int depth = 0);
 
     /**
      * Test this sheet
@@ -684,6 +881,9 @@ class Sheet : public Component {
      * this does not actually run the test cells (that is done on
      * an as-needed basis using update), it just reports on them.
      *
+     * An expression cell is covered if it is a predecessor (direct or indirect)
+     * of at least one test cell.
+     *
      * @return A JSOn document containing test results
      */
     Json::Document test(void) const;
@@ -705,27 +905,33 @@ class Sheet : public Component {
 
  private:
     /**
-     * Custom comparison to have column first ordering and row ordering
-     * that is numeric, not string based (i.e "3" < "10")
-     */
-    struct IdComparison {
-        bool operator()(const std::string& id1, const std::string& id2) const {
-            auto in1 = Sheet::index(id1);
-            auto in2 = Sheet::index(id2);
-            // If same column, ...
-            if (in1[1] == in2[1]) {
-                // then compare row...
-                return in1[0] < in2[0];
-            }
-            // otherwise, compare column
-            return in1[1] < in2[1];
-        }
-    };
+     * Key for a cell within `cells_`
+     *
+     * Packs the column index into the upper, and the row index into the lower, 32 bits so
+     * that cells are ordered column first and with numeric, not string based,
+     * row ordering (i.e "3" < "10"). String ids are only used at the API boundary.
+     */
+    typedef uint64_t Key;
+
+    /**
+     * Generate a key for a cell from its row and column indices
+     */
+    static Key key(unsigned int row, unsigned int col) {
+        return (static_cast<Key>(col) << 32) | row;
+    }
+
+    /**
+     * Generate a key for a cell from its identifier
+     */
+    static Key key(const std::string& id) {
+        auto indices = index(id);
+        return key(indices[0], indices[1]);
+    }
 
     /**
      * A map of cells having content
      */
-    std::map<std::string, Cell, IdComparison> cells_;
+    std::map<Key, Cell> cells_;
 
     /**
      * A map of cell names to cell ids
@@ -771,11 +977,243 @@ class Sheet : public Component {
      */
     std::vector<std::string> order_;
 
+    /**
+     * Position of each vertex within `order_`
+     *
+     * Indexed by vertex (`boost::vecS` vertices are contiguous integers)
+     * and used to maintain the topological order incrementally as edges are added
+     */
+    std::vector<unsigned int> positions_;
+
+    /**
+     * A map of cell ranges (e.g. `A1:A100`) to their corners (row1, col1, row2, col2)
+     *
+     * Each range referred to in a cell expression has a single vertex in the
+     * dependency graph with edges from the existing cells within it. A cell which depends
+     * upon a range has a single edge from it, regardless of the size of the range.
+     */
+    std::map<std::string, std::array<unsigned int, 4>> ranges_;
+
+    /**
+     * The ranges in `ranges_` which span each column
+     *
+     * Used to find the ranges that a new cell falls within without
+     * checking every range in the sheet
+     */
+    std::map<unsigned int, std::vector<std::string>> range_columns_;
+
+    /**
+     * A sheet expression translated for the spread
+     */
+    struct Translation {
+        /**
+         * Expression in the host language of the spread
+         */
+        std::string expression;
+
+        /**
+         * Ids of the cells, and ranges, that the expression depends upon
+         */
+        std::vector<std::string> depends;
+    };
+
+    /**
+     * A cache of translations keyed by the sheet expression
+     *
+     * Avoids re-translating unchanged expressions and asking the spread
+     * for their dependencies. Because names within dependencies are resolved
+     * to ids it is cleared when names change (and when the spread changes).
+     */
+    std::map<std::string, Translation> translations_;
+
+    /**
+     * Get the translation of a sheet expression, using the cache
+     * if possible
+     *
+     * @param expression Sheet expression
+     */
+    const Translation& translation(const std::string& expression);
+
+    /**
+     * Translate sheet expressions, which are not already cached, getting
+     * their dependencies from the spread in a single batch
+     *
+     * @param expressions Sheet expressions
+     */
+    void translations(const std::vector<std::string>& expressions);
+
+    /**
+     * A cache of the HTML for Cila cells keyed by their Cila source
+     *
+     * Since the HTML only depends upon the source it is not cleared along
+     * with the other caches.
+     */
+    std::map<std::string, std::string> cilas_;
+
+    /**
+     * Number of expression cells which are predecessors of at least one test cell
+     *
+     * Cached by `test()` (-1 if not yet calculated) and invalidated by `update()` when the
+     * dependency graph or the kind of a cell changes
+     */
+    mutable int covered_ = -1;
+
+    /**
+     * Cached predecessors (`[0]`) and successors (`[1]`) of vertices, with no depth limit,
+     * cleared when the dependency graph changes
+     */
+    std::array<std::map<Vertex, std::vector<std::string>>, 2> closures_;
+
+    /**
+     * Get the predecessors or successors of a cell
+     *
+     * @see `predecessors()` and `successors()`
+     */
+    std::vector<std::string> related(const std::string& id, unsigned int depth, bool successors);
+
+    /**
+     * Invalidate the caches which depend upon the dependency graph
+     *
+     * Called when edges are added to, or removed from, the graph
+     */
+    void invalidate(void);
+
+    /**
+     * Update the sheet given changes to cells
+     *
+     * @see public `update()` method
+     *
+     * @param notify Function called with each changed cell (optional)
+     * @param cancelled Set to `true` if the update was cancelled (optional)
+     * @param requested Cells which must be executed, along with their predecessors, in lazy mode
+     */
+    std::vector<Cell> update(
+        const std::vector<Cell>& changes, bool execute,
+        const std::function<void(const Cell&)>& notify, bool* cancelled,
+        const std::vector<std::string>& requested = {}
+    );
+
+    /**
+     * Number of updates started
+     *
+     * An update in progress is cancelled when this no longer matches
+     * the value it had when the update started
+     */
+    std::atomic<unsigned int> updates_{0};
+
+    /**
+     * Mutex ensuring that only one update is in progress at a time
+     *
+     * Also held by methods which read cells (e.g. `tile()`) or use the spread (e.g. `functions()`)
+     * so that they do not do so while an asynchronous update is modifying the cells or using
+     * the spread (which is not thread safe). Recursive because some of those methods
+     * call `update()` (e.g. `viewport()` via `compute()`)
+     */
+    mutable boost::recursive_mutex updating_;
+
+    /**
+     * Thread for the most recent asynchronous update
+     */
+    std::shared_ptr<boost::thread> worker_;
+
+    /**
+     * Ids of cells which were not executed because an update was cancelled
+     * or because they were not needed in lazy mode
+     */
+    std::set<std::string> stale_;
+
+    /**
+     * Is lazy evaluation mode on?
+     */
+    bool lazy_ = false;
+
+    /**
+     * Region of cells (row1, col1, row2, col2) which is visible
+     */
+    std::array<unsigned int, 4> viewport_ = {{0, 0, 49, 25}};
+
+    /**
+     * Load this sheet from the binary format
+     *
+     * Cells are created directly from the columns of the binary data (e.g. a
+     * memory mapped file) without any intermediate buffers or parsing of sources.
+     *
+     * @param data Pointer to the start of the data
+     * @param size Size of the data
+     */
+    Sheet& load_binary(const char* data, std::size_t size);
+
+    /**
+     * Dump this sheet to the binary format
+     */
+    Sheet& dump_binary(std::ostream& stream);
+
+    /**
+     * Have cell values been restored from the evaluation cache (and
+     * the spread) but not yet updated?
+     */
+    bool restored_ = false;
+
+    /**
+     * Get a hash of the inputs to a cell: its expression and name and 
+     * the values of the cells (including those in ranges) that it depends upon
+     */
+    std::size_t inputs(const Cell& cell) const;
+
     /**
      * Has the dependency graph been initialised ?
      */
     bool prepared_ = false;
 
+    /**
+     * Are `order_` and `positions_` consistent with the dependency graph?
+     *
+     * Set to false when an edge insertion would create a cycle so that
+     * the next update falls back to a full topological sort
+     */
+    bool ordered_ = false;
+
+    /**
+     * Vertices within each cycle in the dependency graph
+     *
+     * The strongly connected components found by the last `sort()` that
+     * have more than one vertex (or a vertex which depends upon itself)
+     */
+    std::vector<std::vector<Vertex>> cycles_;
+
+    /**
+     * Get the dependency graph vertex for a cell, adding one
+     * (at the end of the topological order) if necessary
+     *
+     * If `id` is a range (e.g. `A1:A100`) then a new vertex is connected
+     * to the existing cells within it.
+     *
+     * @param id ID of the cell or range
+     */
+    Vertex vertex(const std::string& id);
+
+    /**
+     * Do a full topological sort of the dependency graph, resetting
+     * `order_` and `positions_`
+     *
+     * If the graph has cycles then they are recorded in `cycles_` and the
+     * remainder of the graph (without edges within cycles) is sorted.
+     */
+    void sort(void);
+
+    /**
+     * Maintain the topological order after the addition of an edge
+     *
+     * Implements the dynamic topological sort algorithm of Pearce & Kelly (2006)
+     * which only repositions vertices within the affected region of the order
+     * (i.e. between the positions of the `to` and `from` vertices).
+     *
+     * @param  from Source of the added edge
+     * @param  to   Target of the added edge
+     * @return      `false` if the edge introduces a cycle
+     */
+    bool reorder(Vertex from, Vertex to);
+
     /**
      * The current spread for this sheet
      */
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <string>
+#include <vector>
+
 #include <stencila/component.hpp>
 #include <stencila/function.hpp>
 
@@ -44,6 +48,41 @@ public:
 	 */
 	virtual std::string set(const std::string& id, const std::string& expression, const std::string& name="") = 0;
 
+	/**
+	 * Assign expressions to a batch of cells
+	 *
+	 * Equivalent to calling `set` for each cell in turn (the cells are in
+	 * topological order) but allows spreads to avoid the overhead of a call into
+	 * the host language for each cell. 
+	 * 
+	 * @param cells List of cell ids, expressions and names
+	 * @return      Type and text representation of each cell value
+	 */
+	virtual std::vector<std::string> set_batch(const std::vector<std::array<std::string, 3>>& cells) {
+		std::vector<std::string> results;
+		for (const auto& cell : cells) {
+			try {
+				results.push_back(set(cell[0], cell[1], cell[2]));
+			} catch (const std::exception& exc) {
+				results.push_back(exc.what());
+			} catch (...) {
+				results.push_back("error Unknown exception");
+			}
+		}
+		return results;
+	}
+
+	/**
+	 * Get the number of threads which can call `set` concurrently
+	 *
+	 * If more than one, the sheet will execute cells which do not depend upon
+	 * each other in parallel. Spreads wrapping an interpreter with a global
+	 * lock should not override this.
+	 */
+	virtual unsigned int concurrency(void) const {
+		return 1;
+	}
+
 	/**
 	 * Get a text representation of a variable in the spread
 	 * 
@@ -75,6 +114,23 @@ public:
 	 */
 	virtual std::string collect(const std::vector<std::string>& cells) = 0;
 
+	/**
+	 * Create an expression for a rectangular range of cells
+	 *
+	 * Unlike `collect`, the expression only contains the corners of the range so
+	 * its size is independent of the size of the range. Spreads which do not
+	 * support ranges should not override this.
+	 *
+	 * @param  row1 Row index of the upper left corner (0-based)
+	 * @param  col1 Column index of the upper left corner (0-based)
+	 * @param  row2 Row index of the lower right corner (0-based)
+	 * @param  col2 Column index of the lower right corner (0-based)
+	 * @return      An expression in the host language, or an empty string if ranges are not supported
+	 */
+	virtual std::string range(unsigned int /*row1*/, unsigned int /*col1*/, unsigned int /*row2*/, unsigned int /*col2*/) {
+		return "";
+	}
+
 	/**
 	 * List the dependencies of a cell expression
      *
@@ -86,6 +142,26 @@ public:
 	 */
 	virtual std::string depends(const std::string& expression) = 0;
 
+	/**
+	 * List the dependencies of a batch of cell expressions
+	 *
+	 * Equivalent to calling `depends` for each expression in turn.
+	 * 
+	 * @return  Comma separated list of names for each expression (empty if
+	 *          the expression could not be parsed)
+	 */
+	virtual std::vector<std::string> depends_batch(const std::vector<std::string>& expressions) {
+		std::vector<std::string> results;
+		for (const auto& expression : expressions) {
+			try {
+				results.push_back(depends(expression));
+			} catch (...) {
+				results.push_back("");
+			}
+		}
+		return results;
+	}
+
 	/**
 	 * List the functions available in this spread
 	 */
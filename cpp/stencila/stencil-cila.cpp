@@ -701,7 +701,7 @@ public:
 
 					auto section = node.append("section").attr("id",id);
 					auto title = match[1].str();
-					auto h1 = section.append("h1").text(title);
+					section.append("h1").text(title);
 					enter(section);
 					across(sol);
 				}
@@ -1706,6 +1706,8 @@ public:
 #if !defined(STENCILA_CILA_INLINE)
 
 Stencil& Stencil::cila(const std::string& string){
+	directives_ = Directives();
+	directives_previous_ = Directives();
 	CilaParser().parse(*this,string);
 	return *this;
 }
@@ -1714,6 +1716,12 @@ std::string Stencil::cila(void) const {
 	return CilaGenerator().generate(*this);
 }
 
+std::string Stencil::cila_html(const std::string& cila){
+	Xml::Document doc;
+	CilaParser().parse(doc,cila);
+	return trim(Html::Fragment(doc).dump(false));
+}
+
 #endif
 
 }
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -196,6 +198,25 @@ namespace {
 	}
 }
 
+template<class Parsed>
+const Parsed& Stencil::directive_(std::map<std::string,Parsed> Directives::* table, const std::string& attribute){
+	auto& directives = directives_.*table;
+	auto found = directives.find(attribute);
+	if(found!=directives.end()) return found->second;
+	// Move from the previous render's table if it was parsed then
+	auto& previous = directives_previous_.*table;
+	auto reused = previous.find(attribute);
+	if(reused!=previous.end()){
+		auto& directive = directives.insert(*reused).first->second;
+		previous.erase(reused);
+		return directive;
+	}
+	// Parse before inserting so that invalid directives are not added
+	Parsed directive;
+	directive.parse(attribute);
+	return directives.insert({attribute,directive}).first->second;
+}
+
 void Stencil::error(Node node, const std::string& type, const std::string& data){
 	auto value = type;
 	if(data.length()){
@@ -276,7 +297,7 @@ void Stencil::Execute::parse(Node node){
 }
 
 void Stencil::Execute::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::execs,node.attr("data-exec"));
 
 	// Check that the context accepts the declared contexts types
 	bool accepted = false;
@@ -416,7 +437,7 @@ void Stencil::Where::scan(Node node){
 }
 
 void Stencil::Where::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	scan(node);
+	*this = stencil.directive_(&Directives::wheres,node.attr("data-where"));
 	bool ok = false;
 	for(auto& item : contexts){
 		if(context->accept(item)){
@@ -458,7 +479,7 @@ void Stencil::Attr::parse(Node node){
 }
 
 void Stencil::Attr::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::attrs,node.attr("data-attr"));
 	auto add = true;
 	if(given.length()) add = context->test(given);
 	if(add){
@@ -491,7 +512,7 @@ void Stencil::Text::parse(Node node){
 }
 
 void Stencil::Text::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::texts,node.attr("data-text"));
 	if(node.attr("data-lock")!="true"){
 		auto text = context->write(expression);
 		node.text(text);
@@ -521,7 +542,7 @@ void Stencil::With::parse(Node node){
 }
 
 void Stencil::With::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::withs,node.attr("data-with"));
 	context->enter(expression);
 	stencil.render_children(node,context);
 	context->exit();
@@ -628,7 +649,7 @@ void Stencil::For::parse(const std::string& attribute){
 }
 
 void Stencil::For::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node.attr("data-for"));
+	*this = stencil.directive_(&Directives::fors,node.attr("data-for"));
 
 	// Initialise the loop
 	bool more = context->begin(item,items);
@@ -637,20 +658,38 @@ void Stencil::For::render(Stencil& stencil, Node node, std::shared_ptr<Context>
 	// The first element will have a `data-each` attribute either explicitly or
 	// because a previous rendering added on. So erase that attribute so that the repeated nodes don't get it
 	if(each) each.erase("data-each");
+	// Index the children rendered previously by their `data-index` so that
+	// each item does not need to be searched for. Only children (not other decendents)
+	// are indexed to prevent messing with nested loops. Where there is more than one child 
+	// with the same index, the first is used (the others are left as they are).
+	// The index is sorted, rather than being a vector indexed by `data-index`, so
+	// that its size does not depend upon the values of `data-index`.
+	std::vector<std::pair<int,Node>> existing;
+	std::vector<std::pair<int,Node>> indexeds;
+	for(Node child = node.first_element(); child; child = child.next_element()){
+		std::string index_string = child.attr("data-index");
+		if(index_string.length()){
+			int index = unstring<int>(index_string);
+			indexeds.push_back({index,child});
+			if(index>=0 and string(index)==index_string){
+				existing.push_back({index,child});
+			}
+		}
+	}
+	std::stable_sort(existing.begin(), existing.end(), [](const std::pair<int,Node>& a, const std::pair<int,Node>& b){
+		return a.first < b.first;
+	});
+	auto next = existing.begin();
 	// Iterate
 	int count = 0;
 	while(each and more){
 		// See if there is an existing child with a corresponding `data-index`
-		std::string index = string(count);
-		// Must select only children (not other decendents) to prevent messing with
-		// nested loops. 
-		// Currently, our CSS selector implementation does not support this syntax:
-		//     > [data-index="0"]
-		// so use XPath instead:
-		Node item = node.select("./*[@data-index='"+index+"']","xpath");
+		Node item;
+		while(next != existing.end() and next->first < count) next++;
+		if(next != existing.end() and next->first == count) item = next->second;
 		if(item){
 			// If there is, check to see if it is locked
-			Node locked = item.select("./*[@data-lock]","xpath");
+			Node locked = item.select("> [data-lock]");
 			if(not locked){
 				// If it is not locked, then destroy and replace it
 				item.destroy();
@@ -666,7 +705,7 @@ void Stencil::For::render(Stencil& stencil, Node node, std::shared_ptr<Context>
 		// each item
 		scrub(item);
 		// Set index flag
-		item.attr("data-index",index);
+		item.attr("data-index",string(count));
 		// Ask context to step to next item
 		more = context->next();
 		count++;
@@ -674,19 +713,17 @@ void Stencil::For::render(Stencil& stencil, Node node, std::shared_ptr<Context>
 	// Add back the `data-each` attribute to the child
 	if(each) each.attr("data-each","true");
 	// Remove any children having a `data-index` attribute greater than the 
-	// number of items, unless it has a `data-lock` decendent
-	Nodes indexeds = node.filter("./*[@data-index]","xpath");
-	for(Node indexed : indexeds){
-		std::string index_string = indexed.attr("data-index");
-		int index = unstring<int>(index_string);
-		if(index>count-1){
-			Node locked = indexed.select("[data-lock]");
+	// number of items, unless it has a `data-lock` decendent. These were not
+	// touched by the loop above so are still valid.
+	for(auto& indexed : indexeds){
+		if(indexed.first>count-1){
+			Node locked = indexed.second.select("[data-lock]");
 			if(locked){
-				indexed.attr("data-extra","true");
+				indexed.second.attr("data-extra","true");
 				// Move the end of the `for` element
-				indexed.move(node);
+				indexed.second.move(node);
 			}
-			else indexed.destroy();
+			else indexed.second.destroy();
 		}
 	}
 }
@@ -721,7 +758,7 @@ void Stencil::Parameter::parse(Node node){
 }
 
 void Stencil::Parameter::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::pars,node.attr("data-par"));
 
 	// Create a <label> element if necessary 
 	// (an explicit <label> may already be presetn)
@@ -797,7 +834,7 @@ void Stencil::Set::parse(Node node){
 }
 
 void Stencil::Set::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::sets,node.attr("data-set"));
 	context->assign(name,value);
 }
 
@@ -834,7 +871,7 @@ void Stencil::Include::parse(Node node){
 }
 
 void Stencil::Include::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::includes,node.attr("data-include"));
 
 	// If this node has been rendered before then there will be 
 	// a `data-included` node. If it does not yet exist then append one.
@@ -1011,7 +1048,7 @@ void Stencil::Macro::parse(Node node){
 }
 
 void Stencil::Macro::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::macros,node.attr("data-macro"));
 	// Add id to element so it can be selected
 	node.attr("id",name);
 }
@@ -1048,7 +1085,7 @@ void Stencil::Create::parse(Node node){
 }
 
 void Stencil::Create::render(Stencil& stencil, Node node, std::shared_ptr<Context> context){
-	parse(node);
+	*this = stencil.directive_(&Directives::creates,node.attr("data-create"));
 
 	// Enter a new named namespace.
 	context->enter();
@@ -29,8 +29,10 @@ std::string Stencil::html(bool document, bool pretty) const {
 }
 
 Stencil& Stencil::html(const std::string& html){
-	// Clear content before appending new content from Html::Document
+	// Clear content (and directives parsed from it) before appending new content from Html::Document
 	clear();
+	directives_ = Directives();
+	directives_previous_ = Directives();
 	Html::Document doc(html);
 	auto body = doc.find("body");
 	if(auto elem = body.find("main","id","content")){
@@ -1,6 +1,5 @@
 #include <memory>
 
-#include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/regex.hpp>
 
@@ -21,6 +20,30 @@ namespace {
 	    }
 	    return id;
 	}
+
+	// Directive attributes which are dispatched to a rendering method.
+	// Used to avoid comparing each attribute against each directive name.
+	enum class DirectiveType {
+		exec, where, attr, text, with, if_, elif, else_, switch_, case_, default_, for_, include, set, par, macro
+	};
+	const std::map<std::string,DirectiveType> directive_types = {
+		{"data-exec",DirectiveType::exec},
+		{"data-where",DirectiveType::where},
+		{"data-attr",DirectiveType::attr},
+		{"data-text",DirectiveType::text},
+		{"data-with",DirectiveType::with},
+		{"data-if",DirectiveType::if_},
+		{"data-elif",DirectiveType::elif},
+		{"data-else",DirectiveType::else_},
+		{"data-switch",DirectiveType::switch_},
+		{"data-case",DirectiveType::case_},
+		{"data-default",DirectiveType::default_},
+		{"data-for",DirectiveType::for_},
+		{"data-include",DirectiveType::include},
+		{"data-set",DirectiveType::set},
+		{"data-par",DirectiveType::par},
+		{"data-macro",DirectiveType::macro}
+	};
 }
 
 namespace Stencila {
@@ -52,8 +75,9 @@ void Stencil::render(Node node, std::shared_ptr<Context> context){
 		//...use the name of the attribute to dispatch to another rendering method
 		//   Note that return is used so that only the first Stencila "data-xxx" will be 
 		//   considered and that directive will determine how/if children nodes are processed
-		for(std::string attr : node.attrs()){		
-			if(attr=="data-exec"){
+		for(std::string attr : node.attrs()){
+			auto directive = directive_types.find(attr);
+			if(directive!=directive_types.end() and directive->second==DirectiveType::exec){
 				// Exec directives check for hash changes before being rexecuted.
 				// So don't remove errors or warnings, otherwise if the code has not been changed,
 				// and the directive is not re-executed, these will be lost
@@ -63,29 +87,36 @@ void Stencil::render(Node node, std::shared_ptr<Context> context){
 				// So, remove any existing error or waring flags
 				node.erase("data-error");
 				node.erase("data-warning");
-	
-				if(attr=="data-where") return Where().render(*this,node,context);
-				else if(attr=="data-attr") return Attr().render(*this,node,context);
-				else if(attr=="data-text") return Text().render(*this,node,context);
-				else if(attr=="data-with") return With().render(*this,node,context);
 
-				else if(attr=="data-if") return If().render(*this,node,context);
-				// Ignore `elif` and `else` elements as these are processed by `if`
-				// and the `render_children` below should not necessarily be called for them
-				else if(attr=="data-elif" or attr=="data-else") return;
+				if(directive==directive_types.end()) continue;
+				switch(directive->second){
+					case DirectiveType::where: return Where().render(*this,node,context);
+					case DirectiveType::attr: return Attr().render(*this,node,context);
+					case DirectiveType::text: return Text().render(*this,node,context);
+					case DirectiveType::with: return With().render(*this,node,context);
+
+					case DirectiveType::if_: return If().render(*this,node,context);
+					// Ignore `elif` and `else` elements as these are processed by `if`
+					// and the `render_children` below should not necessarily be called for them
+					case DirectiveType::elif:
+					case DirectiveType::else_: return;
 
-				else if(attr=="data-switch") return Switch().render(*this,node,context);
-				// Ignore `case` and `default` elements as these a processed by `switch`
-				// and the `render_children` below should not necessarily be called for them
-				else if(attr=="data-case" or attr=="data-default") return;
+					case DirectiveType::switch_: return Switch().render(*this,node,context);
+					// Ignore `case` and `default` elements as these a processed by `switch`
+					// and the `render_children` below should not necessarily be called for them
+					case DirectiveType::case_:
+					case DirectiveType::default_: return;
 
-				else if(attr=="data-for") return For().render(*this,node,context);
+					case DirectiveType::for_: return For().render(*this,node,context);
 
-				else if(attr=="data-include") return Include().render(*this,node,context);
-				else if(attr=="data-set") return Set().render(*this,node,context);
-				else if(attr=="data-par") return Parameter().render(*this,node,context);
+					case DirectiveType::include: return Include().render(*this,node,context);
+					case DirectiveType::set: return Set().render(*this,node,context);
+					case DirectiveType::par: return Parameter().render(*this,node,context);
 
-				else if(attr=="data-macro") return Macro().render(*this,node,context);
+					case DirectiveType::macro: return Macro().render(*this,node,context);
+
+					default: break;
+				}
 			}
 		}
 		// Render input elements
@@ -191,20 +222,18 @@ Stencil& Stencil::render(std::shared_ptr<Context> context){
 	// If a different context, attach the new one
 	if(context!=context_) attach(context);
 	
-	// Change to the stencil's directory
-	boost::filesystem::path cwd = boost::filesystem::current_path();
-	boost::filesystem::path path = boost::filesystem::path(Component::path(true));
-	try {
-		boost::filesystem::current_path(path);
-	} catch(const std::exception& exc){
-		STENCILA_THROW(Exception,"Error setting directory to <"+path.string()+">");
-	}
+	// Change to the stencil's directory (returning to the current directory when done)
+	WorkingDirectory directory(*this);
 	// Reset flags and counts
 	counts_["input"] = 0;
 	counts_["table-caption"] = 0;
 	counts_["figure-caption"] = 0;
 	// Reset hash
 	hash_ = "";
+	// Set aside the directives parsed during the last render so that
+	// those which are not rendered this time are dropped
+	directives_previous_ = std::move(directives_);
+	directives_ = Directives();
 	// Reset outline outline
 	Node outline = select("#outline");
 	if(outline){
@@ -250,7 +279,7 @@ Stencil& Stencil::render(std::shared_ptr<Context> context){
 				reference = "-";
 			}
 			// Create the link
-			Node a = ref.append(
+			ref.append(
 				"a",
 				{{"href","#"+id}},
 				reference
@@ -260,8 +289,6 @@ Stencil& Stencil::render(std::shared_ptr<Context> context){
 		}
 	}
 
-	// Return to the cwd
-	boost::filesystem::current_path(cwd);
 	return *this;
 }
 
@@ -1,7 +1,5 @@
 #include <cstdlib>
 
-#include <boost/filesystem.hpp>
-
 #include <stencila/component-page.hpp>
 #include <stencila/json.hpp>
 #include <stencila/stencil.hpp>
@@ -122,10 +120,8 @@ std::string Stencil::request(const std::string& verb,const std::string& method,c
 
 std::string Stencil::interact(const std::string& code){
 	if(context_){
-		// Switch to stencil's directory
-		boost::filesystem::path cwd = boost::filesystem::current_path();
-		boost::filesystem::path path = boost::filesystem::path(Component::path(true)); 
-		boost::filesystem::current_path(path);
+		// Switch to stencil's directory (returning to the current directory when done)
+		WorkingDirectory directory(*this);
 		// Create a new unique id
 		static char chars[] = {
 			'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v','w','x','y','z',
@@ -135,10 +131,7 @@ std::string Stencil::interact(const std::string& code){
 		std::string id;
 		for(int cha=0;cha<8;cha++) id += chars[int(std::rand()/double(RAND_MAX)*sizeof(chars))];
 		// Run code in context
-		auto result = context_->interact(code,id);
-		// Return to original working directory
-		boost::filesystem::current_path(cwd);
-		return result;
+		return context_->interact(code,id);
 	} else {
 		STENCILA_THROW(Exception,"No context attached to this stencil");
 	}
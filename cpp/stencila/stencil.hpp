@@ -187,6 +187,16 @@ public:
 	 */
 	Stencil& cila(const std::string& cila);
 
+	/**
+	 * Convert Cila to HTML
+	 *
+	 * Equivalent to `Stencil().cila(cila).html()` but parses the Cila into
+	 * a plain `Xml::Document` rather than constructing a `Stencil`.
+	 * 
+	 * @param cila A string of Cila code
+	 */
+	static std::string cila_html(const std::string& cila);
+
 	/**
 	 * @}
 	 */
@@ -1021,6 +1031,46 @@ private:
 
 	std::map<std::string,std::pair<Node,bool>> aliases_;
 
+	/**
+	 * Directives parsed during rendering
+	 *
+	 * Parsing a directive's attribute (often using a regex) only depends upon the attribute's value.
+	 * So, directives are parsed the first time each value is rendered and the parsed directive is reused 
+	 * on subsequent renders until the attribute changes. Cleared when the stencil's content is replaced.
+	 */
+	struct Directives {
+		std::map<std::string,Execute> execs;
+		std::map<std::string,Where> wheres;
+		std::map<std::string,Attr> attrs;
+		std::map<std::string,Text> texts;
+		std::map<std::string,With> withs;
+		std::map<std::string,For> fors;
+		std::map<std::string,Parameter> pars;
+		std::map<std::string,Set> sets;
+		std::map<std::string,Include> includes;
+		std::map<std::string,Macro> macros;
+		std::map<std::string,Create> creates;
+	} directives_;
+
+	/**
+	 * Directives parsed during the previous render
+	 *
+	 * At the start of each render `directives_` is moved here and only the directives which are
+	 * rendered again are moved back. So directives whose attribute values are no longer in the stencil
+	 * (e.g. those generated with a different value on each render) are dropped rather than accumulating.
+	 */
+	Directives directives_previous_;
+
+	/**
+	 * Get a parsed directive from one of the tables in `directives_`,
+	 * reusing it from the previous render or parsing it if necessary
+	 *
+	 * @param table     Table of parsed directives e.g. `&Directives::execs`
+	 * @param attribute Value of the directive's attribute
+	 */
+	template<class Parsed>
+	const Parsed& directive_(std::map<std::string,Parsed> Directives::* table, const std::string& attribute);
+
 };
 
 }
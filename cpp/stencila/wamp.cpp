@@ -72,10 +72,17 @@ Json::Document Message::kwargs(void) const {
     return (*this)[CALL_KWARGS];
 }
 
-Message Message::result(const Json::Document& value) const {
+bool Message::progressive(void) const {
+    if (size()<=CALL_OPTIONS) return false;
+    auto options = (*this)[CALL_OPTIONS];
+    return options.has("receive_progress") and options["receive_progress"].as<bool>();
+}
+
+Message Message::result(const Json::Document& value, bool progress) const {
     Message result(RESULT);
     result.append(request());
     Json::Document details = Json::Object();
+    if (progress) details.append("progress", true);
     result.append(details);
     Json::Document yield_args = Json::Array();
     yield_args.append(value);
@@ -138,10 +138,21 @@ class Message : public Json::Document {
      */
     Json::Document kwargs(void) const;
 
+    /**
+     * Does the caller accept progressive results?
+     *
+     * i.e. was the call made with the `receive_progress` option
+     * (https://github.com/wamp-proto/wamp-proto/blob/master/rfc/text/advanced/ap_rpc_progressive_call_results.md)
+     */
+    bool progressive(void) const;
+
     /**
      * Generate a result message
+     *
+     * @param result The result
+     * @param progress Is this a progressive result (which will be followed by others)?
      */
-    Message result(const Json::Document& result) const;
+    Message result(const Json::Document& result, bool progress = false) const;
 
     /**
      * Generate a error message
@@ -16,7 +16,7 @@ Node& Node::patch(const Node& patch){
    		auto selector = operation.attr("sel");
         if(not selector.length()) STENCILA_THROW(Exception, "Patch operation is missing `sel` attribute for selector");
 
-        auto target = pimpl_->select_single_node(selector.c_str());
+        auto target = pugi_().select_single_node(selector.c_str());
         if(not target) STENCILA_THROW(Exception, "Selector is not valid");
         Node target_node = target.node();
         auto target_attr = target.attribute();
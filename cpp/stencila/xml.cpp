@@ -1,3 +1,10 @@
+#include <cctype>
+#include <cstring>
+#include <list>
+#include <map>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/xpressive/xpressive_static.hpp>
 
 #include <pugixml.hpp>
@@ -10,45 +17,39 @@ namespace Stencila {
 namespace Xml {
 
 Node::Node(void):
-	pimpl_(new pugi::xml_node){
+	handle_(nullptr){
 }
 
 Node::Node(const pugi::xml_node& node):
-	pimpl_(new pugi::xml_node(node)){
-}
-
-Node::Node(const Node& node):
-	pimpl_(new pugi::xml_node(*node.pimpl_)){
+	handle_(node.internal_object()){
 }
 
-Node::~Node(void) = default;
-
 bool Node::exists(void) const {
-	return not pimpl_->empty();
+	return handle_ != nullptr;
 }
 
 bool Node::is_document(void) const {
-	return pimpl_->type()==pugi::node_document;
+	return pugi_().type()==pugi::node_document;
 }
 
 bool Node::is_doctype(void) const {
-	return pimpl_->type()==pugi::node_doctype;
+	return pugi_().type()==pugi::node_doctype;
 }
 
 bool Node::is_element(void) const {
-	return pimpl_->type()==pugi::node_element;
+	return pugi_().type()==pugi::node_element;
 }
 
 bool Node::is_text(void) const {
-	return pimpl_->type()==pugi::node_pcdata;
+	return pugi_().type()==pugi::node_pcdata;
 }
 
 bool Node::is_cdata(void) const {
-	return pimpl_->type()==pugi::node_cdata;
+	return pugi_().type()==pugi::node_cdata;
 }
 
 std::string Node::name(void) const {
-	return pimpl_->name();
+	return pugi_().name();
 }
 
 bool Node::has(const std::string& name) const {
@@ -64,13 +65,13 @@ std::string Node::attr(const std::string& name) const {
 Node& Node::attr(const std::string& name,const std::string& value){
 	auto attr = attr_(name);
 	if(not attr.empty()) attr.set_value(value.c_str());
-	else pimpl_->append_attribute(name.c_str()) = value.c_str();
+	else pugi_().append_attribute(name.c_str()) = value.c_str();
 	return *this;
 }
 
 std::vector<std::string> Node::attrs(void) const {
 	std::vector<std::string> attrs;
-	for(pugi::xml_attribute attr = pimpl_->first_attribute(); attr; attr = attr.next_attribute()){
+	for(pugi::xml_attribute attr = pugi_().first_attribute(); attr; attr = attr.next_attribute()){
 		attrs.push_back(attr.name());
 	}
 	return attrs;
@@ -85,71 +86,71 @@ Node& Node::concat(const std::string& name, const std::string& value, const std:
 		else future = value;
 		attr.set_value(future.c_str());
 	}else {
-		pimpl_->append_attribute(name.c_str()) = value.c_str();
+		pugi_().append_attribute(name.c_str()) = value.c_str();
 	}
 	return *this;
 }
 
 Node& Node::erase(const std::string& name){
 	auto attr = attr_(name);
-	if(attr) pimpl_->remove_attribute(attr);
+	if(attr) pugi_().remove_attribute(attr);
 	return *this;
 }
 
 std::string Node::text(void) const {
-	return pimpl_->text().get();
+	return pugi_().text().get();
 }
 
 Node& Node::text(const std::string& text) {
-	pimpl_->text().set(text.c_str());
+	pugi_().text().set(text.c_str());
 	return *this;
 }
 
 Node Node::append(const Node& node) {
-	return pimpl_->append_copy(*node.pimpl_);
+	return pugi_().append_copy(node.pugi_());
 }
 
 Node Node::append(const Document& doc) {
 	// To append a document it is necessary to append each of
 	// it children (instead of just the document root) like this...
-	for(auto child : doc.children()) pimpl_->append_copy(*child.pimpl_);
+	for(auto child : doc.children()) pugi_().append_copy(child.pugi_());
 	return *this;
 }
 
 Node Node::append(const std::string& tag) {
-	return pimpl_->append_child(tag.c_str());
+	return pugi_().append_child(tag.c_str());
 }
 
 Node Node::append(const std::string& tag, const std::string& text) {
 	Node child = append(tag);
-	child.pimpl_->append_child(pugi::node_pcdata).set_value(text.c_str());
+	child.pugi_().append_child(pugi::node_pcdata).set_value(text.c_str());
 	return child;
 }
 
 Node Node::append(const std::string& tag, const Attributes& attributes, const std::string& text) {
 	Node child = append(tag);
 	for(auto attribute : attributes){
-		child.pimpl_->append_attribute(attribute.first.c_str()) = attribute.second.c_str();
+		child.pugi_().append_attribute(attribute.first.c_str()) = attribute.second.c_str();
 	}
-	if(text.length()>0) child.pimpl_->append_child(pugi::node_pcdata).set_value(text.c_str());
+	if(text.length()>0) child.pugi_().append_child(pugi::node_pcdata).set_value(text.c_str());
 	return child;
 }
 
 Node Node::append_text(const std::string& text){
-	Node child = pimpl_->append_child(pugi::node_pcdata);
+	Node child = pugi_().append_child(pugi::node_pcdata);
 	child.text(text);
 	return child;
 }
 
 Node Node::append_cdata(const std::string& cdata){
-	Node child = pimpl_->append_child(pugi::node_cdata);
+	Node child = pugi_().append_child(pugi::node_cdata);
 	child.text(cdata);
 	return child;
 }
 
 Node Node::append_comment(const std::string& comment){
-	Node child = pimpl_->append_child(pugi::node_comment);
-	child.pimpl_->set_value(comment.c_str());
+	Node child = pugi_().append_child(pugi::node_comment);
+	child.pugi_().set_value(comment.c_str());
 	return child;
 }
 
@@ -162,7 +163,7 @@ Node Node::append_xml(const std::string& xml){
 }   
 
 Node& Node::append(const Nodes& nodes){
-	for(auto node : nodes) pimpl_->append_copy(*node.pimpl_);
+	for(auto node : nodes) pugi_().append_copy(node.pugi_());
 	return *this;
 }
 
@@ -171,30 +172,30 @@ Node& Node::append_children(const Node& other){
 }
 
 Node Node::prepend(Node node){
-	return pimpl_->prepend_copy(*node.pimpl_);
+	return pugi_().prepend_copy(node.pugi_());
 }
 
 Node Node::prepend(const std::string& tag) {
-	return pimpl_->prepend_child(tag.c_str());
+	return pugi_().prepend_child(tag.c_str());
 }
 
 Node Node::prepend(const std::string& tag, const std::string& text) {
 	Node child = prepend(tag);
-	child.pimpl_->append_child(pugi::node_pcdata).set_value(text.c_str());
+	child.pugi_().append_child(pugi::node_pcdata).set_value(text.c_str());
 	return child;
 }
 
 Node Node::prepend(const std::string& tag, const Attributes& attributes, const std::string& text) {
 	Node child = prepend(tag);
 	for(auto attribute : attributes){
-		child.pimpl_->append_attribute(attribute.first.c_str()) = attribute.second.c_str();
+		child.pugi_().append_attribute(attribute.first.c_str()) = attribute.second.c_str();
 	}
-	if(text.length()>0) child.pimpl_->append_child(pugi::node_pcdata).set_value(text.c_str());
+	if(text.length()>0) child.pugi_().append_child(pugi::node_pcdata).set_value(text.c_str());
 	return child;
 }
 
 Node& Node::prepend(const Nodes& nodes){
-	for(auto node = nodes.rbegin(); node != nodes.rend(); ++node) pimpl_->prepend_copy(*(node->pimpl_));
+	for(auto node = nodes.rbegin(); node != nodes.rend(); ++node) pugi_().prepend_copy(node->pugi_());
 	return *this;
 }
 
@@ -203,7 +204,7 @@ Node& Node::prepend_children(const Node& other){
 }
 
 Node Node::before(Node node){
-	return pimpl_->parent().insert_copy_before(*node.pimpl_,*pimpl_);
+	return pugi_().parent().insert_copy_before(node.pugi_(),pugi_());
 }
 
 Node& Node::before(const Nodes& nodes){
@@ -212,7 +213,7 @@ Node& Node::before(const Nodes& nodes){
 }
 
 Node Node::after(Node node){
-	return pimpl_->parent().insert_copy_after(*node.pimpl_,*pimpl_);
+	return pugi_().parent().insert_copy_after(node.pugi_(),pugi_());
 }
 
 Node& Node::after(const Nodes& nodes){
@@ -221,58 +222,58 @@ Node& Node::after(const Nodes& nodes){
 }
 
 Node& Node::remove(const Node& child){
-	pimpl_->remove_child(*child.pimpl_);
+	pugi_().remove_child(child.pugi_());
 	return *this;
 }
 
 Node& Node::clear(void){
-	while(pimpl_->first_child()) pimpl_->remove_child(pimpl_->first_child());
+	while(pugi_().first_child()) pugi_().remove_child(pugi_().first_child());
 	return *this;
 }  
 
 Node& Node::move(Node& to) {
-	to.pimpl_->append_move(*pimpl_);
+	to.pugi_().append_move(pugi_());
 	return *this;
 }  
 
 void Node::destroy(void) {
-	pimpl_->parent().remove_child(*pimpl_);
+	pugi_().parent().remove_child(pugi_());
 }  
 
 Node Node::root(void){
-	return pimpl_->root();
+	return pugi_().root();
 }
 
 Node Node::parent(void) const {
-	return pimpl_->parent();
+	return pugi_().parent();
 }
 
 Nodes Node::children(void) const {
 	Nodes children;
-	for(auto child : pimpl_->children()) children.push_back(child);
+	for(auto child : pugi_().children()) children.push_back(child);
 	return children;
 }
 
 Node Node::first(void) const {
-	return pimpl_->first_child();
+	return pugi_().first_child();
 }
 
 Node Node::first_element(void) const {
-	return pimpl_->find_child([](pugi::xml_node node){
+	return pugi_().find_child([](pugi::xml_node node){
 		return node.type()==pugi::node_element;
 	});
 }
 
 Node Node::last(void) const {
-	return pimpl_->last_child();
+	return pugi_().last_child();
 }
 
 Node Node::next(void){
-	return pimpl_->next_sibling();
+	return pugi_().next_sibling();
 }
 
 Node Node::next_element(void){
-	pugi::xml_node sibling = pimpl_->next_sibling();
+	pugi::xml_node sibling = pugi_().next_sibling();
 	while(sibling){
 		if(sibling.type()==pugi::node_element){
 			return sibling;
@@ -283,56 +284,25 @@ Node Node::next_element(void){
 }
 
 Node Node::previous(void){
-	return pimpl_->previous_sibling();
+	return pugi_().previous_sibling();
 }
 
 Node Node::find(const std::string& tag) const {
-	return pimpl_->find_node([&tag](Node node){return node.name()==tag;});
+	return pugi_().find_node([&tag](Node node){return node.name()==tag;});
 }
 
 Node Node::find(const std::string& tag,const std::string& name) const {
-	return pimpl_->find_node([&tag,&name](const pugi::xml_node& node){
+	return pugi_().find_node([&tag,&name](const pugi::xml_node& node){
 		return node.name()==tag and not node.attribute(name.c_str()).empty();
 	});
 }
 
 Node Node::find(const std::string& tag,const std::string& name,const std::string& value) const {
-	return pimpl_->find_node([&tag,&name,&value](const pugi::xml_node& node){
+	return pugi_().find_node([&tag,&name,&value](const pugi::xml_node& node){
 		return node.name()==tag and node.attribute(name.c_str()).value()==value;
 	});
 }
 
-Node Node::select(const std::string& selector,const std::string& type) const {
-	std::string xpat;
-	if(type=="css") xpat = xpath(selector);
-	else if(type=="xpath") xpat = selector;
-	else STENCILA_THROW(Exception,"Unknown selector type <"+type+">");
-	try {
-		return pimpl_->select_single_node(xpat.c_str()).node();
-	} catch (const pugi::xpath_exception& e){
-		STENCILA_THROW(Exception,e.what());
-	}
-}
-
-Nodes Node::filter(const std::string& selector,const std::string& type) const {
-	std::string xpat;
-	if(type=="css") xpat = xpath(selector);
-	else if(type=="xpath") xpat = selector;
-	else STENCILA_THROW(Exception,"Unknown selector type <"+type+">");
-	try {
-		// Select nodes
-		pugi::xpath_node_set selected = pimpl_->select_nodes(xpat.c_str());
-		// Construct Nodes from pugi::xpath_node_set
-		Nodes nodes;
-		for(pugi::xpath_node_set::const_iterator it = selected.begin(); it != selected.end(); ++it){
-			nodes.push_back(it->node());
-		}
-		return nodes;
-	} catch (const pugi::xpath_exception& e){
-		STENCILA_THROW(Exception,e.what());
-	}
-}
-
 Node& Node::sanitize(const Whitelist& whitelist){
 	// Element nodes get checked
 	if(is_element()){
@@ -376,9 +346,9 @@ Node& Node::sanitize(const Whitelist& whitelist){
 std::string Node::dump(bool indent) const {
 	std::ostringstream out;
 	if(!indent){
-		pimpl_->print(out,"",pugi::format_raw);
+		pugi_().print(out,"",pugi::format_raw);
 	} else {
-		pimpl_->print(out,"\t",pugi::format_indent);
+		pugi_().print(out,"\t",pugi::format_indent);
 	}
 	return out.str();
 }
@@ -386,9 +356,9 @@ std::string Node::dump(bool indent) const {
 std::string Node::dump_children(bool indent) const {
 	std::ostringstream out; 
 	if(!indent){
-		for(auto child : pimpl_->children()) child.print(out,"",pugi::format_raw);
+		for(auto child : pugi_().children()) child.print(out,"",pugi::format_raw);
 	} else {
-		for(auto child : pimpl_->children()) child.print(out,"\t",pugi::format_indent);
+		for(auto child : pugi_().children()) child.print(out,"\t",pugi::format_indent);
 	}
 	return out.str();
 }
@@ -396,9 +366,9 @@ std::string Node::dump_children(bool indent) const {
 void Node::write(const std::string& filename,bool indent) const {
 	std::ofstream out(filename);
 	if(!indent){
-		pimpl_->print(out,"",pugi::format_raw);
+		pugi_().print(out,"",pugi::format_raw);
 	} else {
-		pimpl_->print(out,"\t",pugi::format_indent);
+		pugi_().print(out,"\t",pugi::format_indent);
 	}
 }
 
@@ -417,6 +387,10 @@ Some of the things that are not implemented or not fully implemented:
   * pseudo-class (':')
   * negation ('not(..)')
   * namespaces ('foo|bar')
+
+As an extension, a selector can start with the child combinator (e.g. '> [data-index="0"]')
+to only match children of the node being selected from (rather than the node itself and all of its
+descendants)
 */
 
 using namespace boost::xpressive;
@@ -444,7 +418,9 @@ sregex general_sibling = *space >> '~' >> *space;
 	
 sregex selectors       = selector>>!((descendant | child | adjacent_sibling | general_sibling)>>by_ref(selectors));
 	
-sregex group           = selectors >> *(*space >> ',' >> *space >> selectors);
+sregex scope           = *space >> '>' >> *space;
+
+sregex group           = !scope >> selectors >> *(*space >> ',' >> *space >> !scope >> selectors);
 	
 // Parse a CSS selector into a syntax tree
 smatch parse(const std::string& selector){
@@ -594,15 +570,20 @@ std::string translate(const smatch& node,bool adjacent=false) {
 	}
 	else if(id==group.regex_id()){
 		//Root of sytax tree.
-		std::string xpath = "descendant-or-self::";
-		//Separate selectors using |
+		//Each selector is relative to the context node; its children if
+		//scoped with a leading '>', otherwise itself and its descendants
+		std::string xpath;
+		std::string axis = "descendant-or-self::";
 		auto children = node.nested_results();
-		int n = children.size();
-		int index = 1;
 		for(auto i=children.begin();i!=children.end();i++){
-			xpath += translate(*i);
-			if(index<n) xpath += " | ";
-			index++;
+			if(i->regex_id()==scope.regex_id()){
+				axis = "child::";
+				continue;
+			}
+			//Separate selectors using |
+			if(xpath.length()) xpath += " | ";
+			xpath += axis + translate(*i);
+			axis = "descendant-or-self::";
 		}
 		return xpath;
 	}
@@ -616,24 +597,432 @@ std::string translate(const smatch& node,bool adjacent=false) {
 	}
 }
 
+/*
+Match the CSS syntax tree natively
+
+Rather than translating to XPath and using the general purpose XPath engine, the syntax tree
+is compiled into a list of compound selectors (e.g. `div.a[foo]`) each with the combinator
+relating it to the compound on its left. Candidate elements are visited in document order and
+matched from right to left, so most are rejected by the rightmost compound without looking
+at any of their ancestors or siblings.
+*/
+
+/**
+ * A condition on an attribute of an element
+ *
+ * `op` is the first character of one of the attribute comparison operators (`=`, `~=`, `|=`, `^=`,
+ * `$=`, `*=`) or `0` if the attribute only has to exist. Classes and ids are represented as `~=` and `=`
+ * conditions on the `class` and `id` attributes.
+ */
+struct Condition {
+	std::string name;
+	char op = 0;
+	std::string value;
+};
+
+/**
+ * A compound selector e.g. `div.a[foo]`
+ */
+struct Compound {
+	/**
+	 * Element name or `*`
+	 */
+	std::string name = "*";
+
+	std::vector<Condition> conditions;
+
+	/**
+	 * Combinator relating this compound to the one on its left (`' '`, `'>'`, `'+'` or `'~'`).
+	 * For the leftmost compound either `0` (any element in scope) or `'>'` (a child of the
+	 * node being selected from).
+	 */
+	char combinator = 0;
+};
+
+/**
+ * A complex selector e.g. `div.a > p span`, with compounds from left to right
+ */
+typedef std::vector<Compound> Complex;
+
+/**
+ * A group of complex selectors e.g. `caption,figcaption`
+ */
+typedef std::vector<Complex> Selector;
+
+Condition compile_condition(const smatch& node){
+	const void* id = node.regex_id();
+	Condition condition;
+	if(id==attr_id.regex_id()){
+		condition.name = "id";
+		condition.op = '=';
+		condition.value = node.str(0).substr(1);
+	}
+	else if(id==attr_class.regex_id()){
+		condition.name = "class";
+		condition.op = '~';
+		condition.value = node.str(0).substr(1);
+	}
+	else if(id==attr_exists.regex_id()){
+		condition.name = node.nested_results().begin()->str(0);
+	}
+	else if(id==attr_compare.regex_id()){
+		auto child = node.nested_results().begin();
+		condition.name = child->str(0);
+		condition.op = (++child)->str(0)[0];
+		auto value_node = ++child;
+		if(value_node->regex_id()==string.regex_id()) condition.value = value_node->str(1);
+		else condition.value = value_node->str(0);
+	}
+	else {
+		// An `attr` node wraps one of the above
+		return compile_condition(*node.nested_results().begin());
+	}
+	return condition;
+}
+
+Compound compile_compound(const smatch& node){
+	Compound compound;
+	for(const smatch& child : node.nested_results()){
+		if(child.regex_id()==element.regex_id()) compound.name = child.str(0);
+		else compound.conditions.push_back(compile_condition(child));
+	}
+	return compound;
+}
+
+void compile_complex(const smatch& node, char combinator, Complex& complex){
+	auto children = node.nested_results();
+	auto branch = children.begin();
+	Compound compound = compile_compound(*branch);
+	compound.combinator = combinator;
+	complex.push_back(compound);
+	if(children.size()>1){
+		const void* id = (++branch)->regex_id();
+		if(id==descendant.regex_id()) combinator = ' ';
+		else if(id==child.regex_id()) combinator = '>';
+		else if(id==adjacent_sibling.regex_id()) combinator = '+';
+		else if(id==general_sibling.regex_id()) combinator = '~';
+		compile_complex(*(++branch), combinator, complex);
+	}
+}
+
+Selector compile(const smatch& tree){
+	Selector selector;
+	char combinator = 0;
+	for(const smatch& child : tree.nested_results()){
+		if(child.regex_id()==scope.regex_id()){
+			combinator = '>';
+			continue;
+		}
+		Complex complex;
+		compile_complex(child, combinator, complex);
+		selector.push_back(complex);
+		combinator = 0;
+	}
+	return selector;
+}
+
+/**
+ * Is `word` one of the words in the whitespace separated `list`?
+ */
+bool contains_word(const char* list, const std::string& word){
+	const std::size_t length = word.length();
+	const char* start = list;
+	while(true){
+		while(*start and std::isspace(static_cast<unsigned char>(*start))) start++;
+		if(not *start) return false;
+		const char* end = start;
+		while(*end and not std::isspace(static_cast<unsigned char>(*end))) end++;
+		if(std::size_t(end-start)==length and std::strncmp(start,word.c_str(),length)==0) return true;
+		start = end;
+	}
+}
+
+bool matches(const pugi::xml_node& node, const Compound& compound){
+	if(node.type()!=pugi::node_element) return false;
+	if(compound.name!="*" and std::strcmp(compound.name.c_str(),node.name())!=0) return false;
+	for(const Condition& condition : compound.conditions){
+		pugi::xml_attribute attr = node.attribute(condition.name.c_str());
+		if(not attr) return false;
+		if(not condition.op) continue;
+
+		// Compare against the attribute's value in place rather than copying it
+		const char* actual = attr.value();
+		const char* value = condition.value.c_str();
+		const std::size_t length = condition.value.length();
+		bool ok = false;
+		switch(condition.op){
+			case '=':
+				ok = std::strcmp(actual,value)==0;
+			break;
+			case '~':
+				ok = contains_word(actual,condition.value);
+			break;
+			case '|':
+				ok = std::strncmp(actual,value,length)==0 and (actual[length]==0 or actual[length]=='-');
+			break;
+			case '^':
+				ok = std::strncmp(actual,value,length)==0;
+			break;
+			case '$': {
+				std::size_t actual_length = std::strlen(actual);
+				ok = actual_length>=length and std::strcmp(actual+actual_length-length,value)==0;
+			} break;
+			case '*':
+				ok = std::strstr(actual,value)!=nullptr;
+			break;
+		}
+		if(not ok) return false;
+	}
+	return true;
+}
+
+pugi::xml_node previous_element(const pugi::xml_node& node){
+	pugi::xml_node previous = node.previous_sibling();
+	while(previous and previous.type()!=pugi::node_element) previous = previous.previous_sibling();
+	return previous;
+}
+
+/**
+ * Does a node match a complex selector, from its `index`th compound leftwards?
+ *
+ * `node` must be within `scope` (i.e. the node being selected from or one of its descendants)
+ * and so must any of the nodes which match the compounds to its left.
+ */
+bool matches(const pugi::xml_node& node, const Complex& complex, int index, const pugi::xml_node& scope){
+	const Compound& compound = complex[index];
+	if(not matches(node,compound)) return false;
+	if(compound.combinator==0) return true;
+	if(node==scope) return false;
+	switch(compound.combinator){
+		case '>': {
+			if(index==0) return node.parent()==scope;
+			return matches(node.parent(),complex,index-1,scope);
+		}
+		case ' ': {
+			for(pugi::xml_node ancestor = node.parent(); ancestor; ancestor = ancestor.parent()){
+				if(matches(ancestor,complex,index-1,scope)) return true;
+				if(ancestor==scope) break;
+			}
+			return false;
+		}
+		case '+': {
+			pugi::xml_node previous = previous_element(node);
+			return previous and matches(previous,complex,index-1,scope);
+		}
+		case '~': {
+			for(pugi::xml_node previous = previous_element(node); previous; previous = previous_element(previous)){
+				if(matches(previous,complex,index-1,scope)) return true;
+			}
+			return false;
+		}
+	}
+	return false;
+}
+
+bool matches(const pugi::xml_node& node, const Selector& selector, const pugi::xml_node& scope){
+	for(const Complex& complex : selector){
+		if(matches(node,complex,complex.size()-1,scope)) return true;
+	}
+	return false;
+}
+
+/**
+ * Visit the elements, within `scope`, which match the selector in document order
+ * until `visit` returns false
+ */
+template<typename Visit>
+void traverse(const pugi::xml_node& scope, const Selector& selector, Visit visit){
+	// Only need to visit descendants if no selector is scoped to children
+	// and for those that are only need to look at children if they have only one compound
+	bool deep = false;
+	for(const Complex& complex : selector){
+		if(complex.front().combinator==0 or complex.size()>1) deep = true;
+	}
+	pugi::xml_node node = deep?scope:scope.first_child();
+	while(node){
+		if(matches(node,selector,scope)){
+			if(not visit(node)) return;
+		}
+		// Move to the next node in document order without leaving scope
+		if(deep and node.first_child()) node = node.first_child();
+		else {
+			while(node!=scope and not node.next_sibling()) node = node.parent();
+			if(node==scope) return;
+			node = node.next_sibling();
+		}
+	}
+}
+
+/**
+ * A compiled selector
+ *
+ * CSS selectors are matched natively and XPath selectors by pugixml
+ */
+struct Query {
+	Selector css;
+	std::shared_ptr<pugi::xpath_query> xpath;
+};
+
+/**
+ * A least recently used cache of compiled selectors
+ *
+ * Parsing and compiling a selector is much more expensive than evaluating it, and the same
+ * selectors are used over and over during rendering. Queries are shared so that one evicted 
+ * by another thread stays alive while it is evaluated.
+ */
+class QueryCache {
+public:
+
+	std::shared_ptr<const Query> get(const std::string& selector, const std::string& type) {
+		std::string key = type + ':' + selector;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			auto found = index_.find(key);
+			if (found != index_.end()) {
+				stats_.hits++;
+				// Move to the front of the list
+				queries_.splice(queries_.begin(), queries_, found->second);
+				return found->second->second;
+			}
+			stats_.misses++;
+		}
+
+		// Compile outside of the lock, parsing may throw
+		auto query = std::make_shared<Query>();
+		if (type == "css") {
+			query->css = compile(parse(selector));
+		}
+		else if (type == "xpath") {
+			try {
+				query->xpath = std::make_shared<pugi::xpath_query>(selector.c_str());
+			} catch (const pugi::xpath_exception& e){
+				STENCILA_THROW(Exception, e.what());
+			}
+		}
+		else STENCILA_THROW(Exception, "Unknown selector type <"+type+">");
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		if (stats_.capacity > 0 and index_.find(key) == index_.end()) {
+			queries_.emplace_front(key, query);
+			index_[key] = queries_.begin();
+			while (queries_.size() > stats_.capacity) {
+				index_.erase(queries_.back().first);
+				queries_.pop_back();
+			}
+		}
+		return query;
+	}
+
+	Node::QueryCacheStats stats(void) {
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		Node::QueryCacheStats stats = stats_;
+		stats.size = queries_.size();
+		return stats;
+	}
+
+	void reset(unsigned int capacity) {
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		queries_.clear();
+		index_.clear();
+		stats_ = Node::QueryCacheStats();
+		stats_.capacity = capacity;
+	}
+
+	static QueryCache& instance(void) {
+		static QueryCache cache;
+		return cache;
+	}
+
+private:
+
+	QueryCache(void) {
+		stats_.capacity = 1000;
+	}
+
+	typedef std::list<std::pair<std::string, std::shared_ptr<const Query>>> Queries;
+
+	boost::mutex mutex_;
+
+	Queries queries_;
+
+	std::map<std::string, Queries::iterator> index_;
+
+	Node::QueryCacheStats stats_;
+};
+
 }// anonymous namespace
 
 std::string Node::xpath(const std::string& selector) {
 	return translate(parse(selector));
 }
 
+Node Node::select(const std::string& selector,const std::string& type) const {
+	auto query = QueryCache::instance().get(selector, type);
+	if(query->xpath){
+		try {
+			return pugi_().select_node(*query->xpath).node();
+		} catch (const pugi::xpath_exception& e){
+			STENCILA_THROW(Exception,e.what());
+		}
+	}
+	// Stop at the first match
+	pugi::xml_node selected;
+	traverse(pugi_(), query->css, [&selected](const pugi::xml_node& node){
+		selected = node;
+		return false;
+	});
+	return selected;
+}
+
+Nodes Node::filter(const std::string& selector,const std::string& type) const {
+	auto query = QueryCache::instance().get(selector, type);
+	Nodes nodes;
+	if(query->xpath){
+		try {
+			// Select nodes
+			pugi::xpath_node_set selected = pugi_().select_nodes(*query->xpath);
+			// Construct Nodes from pugi::xpath_node_set
+			nodes.reserve(selected.size());
+			for(pugi::xpath_node_set::const_iterator it = selected.begin(); it != selected.end(); ++it){
+				nodes.push_back(it->node());
+			}
+		} catch (const pugi::xpath_exception& e){
+			STENCILA_THROW(Exception,e.what());
+		}
+	} else {
+		traverse(pugi_(), query->css, [&nodes](const pugi::xml_node& node){
+			nodes.push_back(node);
+			return true;
+		});
+	}
+	return nodes;
+}
+
+Node::QueryCacheStats Node::query_cache(void) {
+	return QueryCache::instance().stats();
+}
+
+void Node::query_cache(unsigned int capacity) {
+	QueryCache::instance().reset(capacity);
+}
+
+pugi::xml_node Node::pugi_(void) const {
+	return pugi::xml_node(handle_);
+}
+
 pugi::xml_attribute Node::attr_(const std::string& name) const {
-	return pimpl_->find_attribute([&name](const pugi::xml_attribute& attr){
+	return pugi_().find_attribute([&name](const pugi::xml_attribute& attr){
 		return attr.name()==name;
 	});
 }
 
-Document::Document(void){
-	pimpl_.reset(new pugi::xml_document);
+Document::Document(void):
+	document_(std::make_shared<pugi::xml_document>()){
+	handle_ = document_->internal_object();
 }
 
-Document::Document(const std::string& html){
-	pimpl_.reset(new pugi::xml_document);
+Document::Document(const std::string& html):
+	Document(){
 	load(html);
 }
 
@@ -672,7 +1061,7 @@ Document& Document::read(const std::string& filename){
 }
 
 pugi::xml_document* Document::doc_(void){
-	return static_cast<pugi::xml_document*>(pimpl_.get());
+	return document_.get();
 }
 
 }
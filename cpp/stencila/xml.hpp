@@ -7,6 +7,7 @@
 #include <stencila/exception.hpp>
 
 namespace pugi {
+	struct xml_node_struct;
 	class xml_attribute;
 	class xml_node;
 	class xml_document;
@@ -53,10 +54,6 @@ public:
 
 	Node(const pugi::xml_node& node);
 
-	Node(const Node& node);
-
-	~Node(void);
-
 	/**
 	 * Does this Node exist in the Document?
 	 */
@@ -489,13 +486,21 @@ public:
 
 	/**
 	 * Get the XPath eqivalent of a CSS selector
-	 * 
+	 *
+	 * Each selector in a group is given its own axis so that, for example, `"a, b"`
+	 * is translated to `"descendant-or-self::a | descendant-or-self::b"` (previously
+	 * `"descendant-or-self::a | b"` which only selected `b` children). A selector with a
+	 * leading child combinator (e.g. `"> a"`) uses the `child::` axis.
+	 *
 	 * @param  selector CSS selector string
 	 */
 	static std::string xpath(const std::string& selector);
 
 	/**
 	 * Get the first element which matches the selector
+	 *
+	 * CSS selectors are matched against this node and its descendants. A CSS selector
+	 * starting with a child combinator (e.g. `> [data-index="0"]`) only matches children of this node.
 	 * 
 	 * @param  selector Selector expression
 	 * @param  type Type of seletor expression, `"css"` or `"xpath"`
@@ -510,6 +515,29 @@ public:
 	 */
 	Nodes filter(const std::string& selector,const std::string& type="css") const;
 
+	/**
+	 * Statistics for the cache of compiled selectors used by `select` and `filter`
+	 */
+	struct QueryCacheStats {
+		unsigned long hits = 0;
+		unsigned long misses = 0;
+		unsigned int size = 0;
+		unsigned int capacity = 0;
+	};
+
+	/**
+	 * Get statistics for the process-wide cache of compiled selectors
+	 */
+	static QueryCacheStats query_cache(void);
+
+	/**
+	 * Clear the process-wide cache of compiled selectors, reset its
+	 * statistics and set its capacity (`0` disables caching)
+	 * 
+	 * @param  capacity Maximum number of compiled selectors to keep
+	 */
+	static void query_cache(unsigned int capacity);
+
 	/**
 	 * @}
 	 */ 
@@ -559,18 +587,24 @@ public:
 
 protected:
 
+	/**
+	 * Get a pugi::xml_node for this node
+	 */
+	pugi::xml_node pugi_(void) const;
+
 	/**
 	 * Get a pugi::xml_attribute for this node
 	 */
 	pugi::xml_attribute attr_(const std::string& name) const;
 
 	/**
-	 * Pointer to implementation
+	 * Handle to the node within its document
 	 *
-	 * Usually std::unique_ptr would be used here. But there were errors when using that
-	 * so use shared_ptr instead. See http://stackoverflow.com/questions/9020372/how-do-i-use-unique-ptr-for-pimpl
+	 * A `pugi::xml_node` is itself just a pointer to a node within a `pugi::xml_document`
+	 * so this class stores that pointer directly. Nodes are therefore cheap to construct
+	 * and copy (no heap allocation) and, like `pugi::xml_node`, do not own the node they refer to.
 	 */
-	std::shared_ptr<pugi::xml_node> pimpl_;
+	pugi::xml_node_struct* handle_;
 };
 
 
@@ -610,8 +644,9 @@ public:
 private:
 	// Pugixml does not allow for copying of `xml_document`s (presumably for efficiency).
 	// To have `Document` derive from `Node` (so it inherits the public interface we define above)
-	// it is necessary to store a pointer to a `pugi::xml_document`, create it and the copy the `pugi::xml_node`
-	// relating to that document (`pugi::xml_node`s are handles to nodes within `pugi::xml_document`s)
+	// it is necessary to store a pointer to a `pugi::xml_document`, create it and set the `Node` handle
+	// to the root of that document. The pointer is shared so that copies of a `Document` remain valid.
+	std::shared_ptr<pugi::xml_document> document_;
 	
 	pugi::xml_document* doc_(void);
 };
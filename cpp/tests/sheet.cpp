@@ -1,7 +1,16 @@
+#include <fstream>
+#include <future>
 #include <memory>
 
+#if !defined(_WIN32)
+	#include <sys/resource.h>
+#endif
+
+#include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/timer/timer.hpp>
 
 #include <stencila/sheet.hpp>
 #include <stencila/function.hpp>
@@ -19,6 +28,7 @@ class TestSpread : public Spread {
 	}
 
 	std::string set(const std::string& id, const std::string& expression, const std::string& name = ""){
+		sets++;
 		std::string type = "string";
 		std::string value;
 		if(expression.find("error")!=std::string::npos) {
@@ -32,6 +42,11 @@ class TestSpread : public Spread {
 		return type + " " + value;
 	}
 
+	std::vector<std::string> set_batch(const std::vector<std::array<std::string, 3>>& cells){
+		batches++;
+		return Spread::set_batch(cells);
+	}
+
 	std::string get(const std::string& name){
 		return variables_[name];
 	}
@@ -61,6 +76,7 @@ class TestSpread : public Spread {
 	}
 
 	std::string depends(const std::string& expression){
+		parses++;
 	    std::vector<std::string> depends;
 	    boost::regex regex("\\w+");
 	    boost::sregex_token_iterator iter(expression.begin(), expression.end(), regex, 0);
@@ -90,10 +106,69 @@ class TestSpread : public Spread {
     void write(const std::string& path) {
     }
 
+	/**
+	 * Number of calls to `set()`, used to check how many
+	 * cells are executed by an update
+	 */
+	unsigned int sets = 0;
+
+	/**
+	 * Number of calls to `depends()`, used to check how many
+	 * expressions are parsed by an update
+	 */
+	unsigned int parses = 0;
+
+	/**
+	 * Number of calls to `set_batch()`
+	 */
+	unsigned int batches = 0;
+
  private:
  	std::map<std::string,std::string> variables_;
 };
 
+/**
+ * A spread which allows `set()` to be called concurrently. Optionally with
+ * a delay in `set()` to simulate the time taken to evaluate an expression
+ */
+class ThreadsafeTestSpread : public TestSpread {
+ public:
+	ThreadsafeTestSpread(unsigned int concurrency = 4, unsigned int delay = 0):
+		concurrency_(concurrency), delay_(delay) {}
+
+	unsigned int concurrency(void) const {
+		return concurrency_;
+	}
+
+	std::string set(const std::string& id, const std::string& expression, const std::string& name = ""){
+		if (delay_) boost::this_thread::sleep_for(boost::chrono::milliseconds(delay_));
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		history.push_back(id);
+		return TestSpread::set(id, expression, name);
+	}
+
+	/**
+	 * The ids of cells in the order that they were set
+	 */
+	std::vector<std::string> history;
+
+ private:
+	unsigned int concurrency_;
+	unsigned int delay_;
+	boost::mutex mutex_;
+};
+
+/**
+ * A spread which supports ranges
+ */
+class RangeTestSpread : public TestSpread {
+ public:
+	std::string range(unsigned int row1, unsigned int col1, unsigned int row2, unsigned int col2) {
+		return "range(" + std::to_string(row1) + "," + std::to_string(col1) + "," + 
+		                  std::to_string(row2) + "," + std::to_string(col2) + ")";
+	}
+};
+
 BOOST_AUTO_TEST_SUITE(sheet_quick)
 
 BOOST_AUTO_TEST_CASE(meta_attributes){
@@ -142,6 +217,8 @@ BOOST_AUTO_TEST_CASE(identify){
 	BOOST_CHECK_EQUAL(Sheet::identify(0,28),"AC1");
 
 	BOOST_CHECK_EQUAL(Sheet::identify(0,52),"BA1");
+	BOOST_CHECK_EQUAL(Sheet::identify(0,701),"ZZ1");
+	BOOST_CHECK_EQUAL(Sheet::identify(0,702),"AAA1");
 }
 
 BOOST_AUTO_TEST_CASE(is_id){
@@ -151,6 +228,43 @@ BOOST_AUTO_TEST_CASE(is_id){
 	BOOST_CHECK(not Sheet::is_id("a1"));
 	BOOST_CHECK(not Sheet::is_id("1A"));
 	BOOST_CHECK(not Sheet::is_id("A0"));
+	BOOST_CHECK(not Sheet::is_id("A01"));
+	BOOST_CHECK(not Sheet::is_id("A1B"));
+	BOOST_CHECK(not Sheet::is_id("A"));
+	BOOST_CHECK(not Sheet::is_id(""));
+	BOOST_CHECK(not Sheet::is_id("A99999999999"));
+
+	// R1C1 notation is not used for ids...
+	BOOST_CHECK(Sheet::is_id("R1"));
+	BOOST_CHECK(not Sheet::is_id("R1C1"));
+}
+
+BOOST_AUTO_TEST_CASE(index){
+	typedef std::array<unsigned int, 2> Indices;
+	BOOST_CHECK(Sheet::index("A1") == Indices({0, 0}));
+	BOOST_CHECK(Sheet::index("C2") == Indices({1, 2}));
+	BOOST_CHECK(Sheet::index("AT45") == Indices({44, 45}));
+	BOOST_CHECK(Sheet::index("R5") == Indices({4, 17}));
+
+	BOOST_CHECK_THROW(Sheet::index("foo"), Exception);
+
+	// ...and so can not be used for indexing (otherwise a cell could have two ids)...
+	BOOST_CHECK_THROW(Sheet::index("R2C3"), Exception);
+
+	// ...except explicitly
+	BOOST_CHECK(Sheet::index_r1c1("R2C3") == Indices({1, 2}));
+	BOOST_CHECK(Sheet::index_r1c1("R45C46") == Indices({44, 45}));
+	BOOST_CHECK_EQUAL(Sheet::identify_r1c1(44, 45), "R45C46");
+
+	BOOST_CHECK_THROW(Sheet::index_r1c1("R0C1"), Exception);
+	BOOST_CHECK_THROW(Sheet::index_r1c1("R1C"), Exception);
+	BOOST_CHECK_THROW(Sheet::index_r1c1("C2"), Exception);
+
+	// Round trip
+	for (unsigned int col : {0u, 25u, 26u, 701u, 702u, 18277u, 18278u}) {
+		BOOST_CHECK(Sheet::index(Sheet::identify(9, col)) == Indices({9, col}));
+		BOOST_CHECK(Sheet::index_r1c1(Sheet::identify_r1c1(9, col)) == Indices({9, col}));
+	}
 }
 
 BOOST_AUTO_TEST_CASE(index_col){
@@ -158,6 +272,9 @@ BOOST_AUTO_TEST_CASE(index_col){
 	BOOST_CHECK_EQUAL(Sheet::index_col("B"),1);
 	BOOST_CHECK_EQUAL(Sheet::index_col("AA"),26);
 	BOOST_CHECK_EQUAL(Sheet::index_col("AB"),27);
+	BOOST_CHECK_EQUAL(Sheet::index_col("BA"),52);
+	BOOST_CHECK_EQUAL(Sheet::index_col("ZZ"),701);
+	BOOST_CHECK_EQUAL(Sheet::index_col("AAA"),702);
 }
 
 BOOST_AUTO_TEST_CASE(interpolate){
@@ -252,6 +369,24 @@ BOOST_AUTO_TEST_CASE(parse){
 	cell.source("Some text");
 	BOOST_CHECK_EQUAL(cell.kind, Cell::text_);
 	BOOST_CHECK_EQUAL(cell.expression,"\"Some text\"");
+
+	// Numbers need digits after any decimal point
+	BOOST_CHECK_EQUAL(cell.source("-.5").kind, Cell::number_);
+	BOOST_CHECK_EQUAL(cell.source("1.").kind, Cell::text_);
+	BOOST_CHECK_EQUAL(cell.source("+").kind, Cell::text_);
+
+	// Directives need an expression
+	BOOST_CHECK_EQUAL(cell.source("=").kind, Cell::text_);
+	BOOST_CHECK_EQUAL(cell.source("foo =").kind, Cell::text_);
+
+	// The cila directive may be within a name
+	cell.source("foo_bar");
+	BOOST_CHECK_EQUAL(cell.kind, Cell::cila_);
+	BOOST_CHECK_EQUAL(cell.name,"foo");
+	BOOST_CHECK_EQUAL(cell.expression,"bar");
+	cell.source("foo_bar = 1");
+	BOOST_CHECK_EQUAL(cell.kind, Cell::expression_);
+	BOOST_CHECK_EQUAL(cell.name,"foo_bar");
 }
 
 BOOST_AUTO_TEST_CASE(translate){
@@ -294,14 +429,79 @@ BOOST_AUTO_TEST_CASE(dependencies_1){
 	BOOST_CHECK_EQUAL(s.successors("B2").size(),0);
 	BOOST_CHECK_EQUAL(s.successors("foo").size(),0);
 
+	// Predecessors and successors are transitive...
+	BOOST_CHECK_EQUAL(join(s.predecessors("B2"), ","), "C2,C1,A2,A1,B1");
+	BOOST_CHECK_EQUAL(join(s.successors("C1"), ","), "A2,A1,B1,B2");
+	// ...and can be limited in depth
+	BOOST_CHECK_EQUAL(join(s.predecessors("B2", 1), ","), "A1,B1");
+	BOOST_CHECK_EQUAL(join(s.predecessors("B2", 2), ","), "A2,A1,B1");
+	BOOST_CHECK_EQUAL(join(s.successors("C1", 1), ","), "A2");
+	BOOST_CHECK_EQUAL(join(s.successors("C1", 3), ","), "A2,A1,B1,B2");
+
 	// Change a cell
 	s.update("B2","= C2");
 	BOOST_CHECK_EQUAL(s.cell("B2").source(), "= C2");
 	BOOST_CHECK_EQUAL(join(s.depends("B2"), ","), "C2");
-	BOOST_CHECK_EQUAL(join(s.order(), ","), "C2,B2,C1,A2,A1,B1");
+	// Order is maintained incrementally so only changes if the new edges require it
+	BOOST_CHECK_EQUAL(join(s.order(), ","), "C2,C1,A2,A1,B1,B2");
+	BOOST_CHECK_EQUAL(join(s.predecessors("B2"), ","), "C2");
+	BOOST_CHECK_EQUAL(join(s.successors("C1"), ","), "A2,A1,B1");
 
 	// Create a circular dependency
-	BOOST_CHECK_THROW(s.update("B2","= A1 + B2"),Exception);
+	s.update("B2","= A1 + B2");
+	BOOST_CHECK_EQUAL(s.cycles().size(), 1u);
+	BOOST_CHECK_EQUAL(join(s.cycles()[0], ","), "B2");
+	BOOST_CHECK_EQUAL(s.cell("B2").type, "error");
+	BOOST_CHECK_EQUAL(s.cell("B2").value, "Cyclic dependency between cells: B2");
+}
+
+BOOST_AUTO_TEST_CASE(cycles){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	s.cells({
+		{"A1","1"},{"B1","= A1"},
+		{"A2","= C2"},{"B2","= A2"},{"C2","= B2"},{"D2","= C2"},{"E2","= D2 + B1"}
+	});
+
+	// Cells within the cycle, and their successors, get an error but the
+	// remainder of the sheet is still executed
+	BOOST_CHECK_EQUAL(s.cycles().size(), 1u);
+	BOOST_CHECK_EQUAL(join(s.cycles()[0], ","), "A2,B2,C2");
+	BOOST_CHECK_EQUAL(spread->sets, 2u);
+	BOOST_CHECK_EQUAL(s.cell("B1").value, "A1");
+	for (std::string id : {"A2","B2","C2"}) {
+		BOOST_CHECK_EQUAL(s.cell(id).type, "error");
+		BOOST_CHECK_EQUAL(s.cell(id).value, "Cyclic dependency between cells: A2, B2, C2");
+	}
+	for (std::string id : {"D2","E2"}) {
+		BOOST_CHECK_EQUAL(s.cell(id).type, "error");
+		BOOST_CHECK_EQUAL(s.cell(id).value, "Depends upon a cell with a cyclic dependency");
+	}
+	auto order = join(s.order(), ",");
+	BOOST_CHECK(order.find("D2") > order.find("C2"));
+	BOOST_CHECK(order.find("E2") > order.find("D2"));
+
+	// Other cells can be updated while the cycle remains
+	spread->sets = 0;
+	s.update("A1","2");
+	BOOST_CHECK_EQUAL(spread->sets, 2u);
+	BOOST_CHECK_EQUAL(s.cell("E2").type, "error");
+
+	// Breaking the cycle executes the cells that were in it and their successors
+	spread->sets = 0;
+	s.update("C2","3");
+	BOOST_CHECK_EQUAL(s.cycles().size(), 0u);
+	BOOST_CHECK_EQUAL(spread->sets, 5u);
+	BOOST_CHECK_EQUAL(s.cell("A2").value, "C2");
+	BOOST_CHECK_EQUAL(s.cell("E2").value, "D2 + B1");
+
+	// Recreating it does not execute any cells
+	spread->sets = 0;
+	auto updates = s.update("C2","= B2");
+	BOOST_CHECK_EQUAL(spread->sets, 0u);
+	BOOST_CHECK_EQUAL(updates.size(), 5u);
+	BOOST_CHECK_EQUAL(s.cell("E2").type, "error");
 }
 
 BOOST_AUTO_TEST_CASE(dependencies_2){
@@ -318,13 +518,127 @@ BOOST_AUTO_TEST_CASE(dependencies_2){
 	BOOST_CHECK_EQUAL(join(s.depends("B2"), ","), "A2");
 	BOOST_CHECK_EQUAL(join(s.order(), ","), "A2,B2,A1,B1");
 
+	// Cells which are earlier in the order, but not depended upon, are not predecessors
+	BOOST_CHECK_EQUAL(join(s.predecessors("B1"), ","), "A1");
+	BOOST_CHECK_EQUAL(s.predecessors("A1").size(), 0);
+	BOOST_CHECK_EQUAL(join(s.successors("A2"), ","), "B2");
+
 	s.update("A1","0");
 	BOOST_CHECK_EQUAL(join(s.depends("A1"), ","), "");
 	BOOST_CHECK_EQUAL(join(s.order(), ","), "A2,B2,A1,B1");
 
 	s.update("B1","0");
 	BOOST_CHECK_EQUAL(join(s.depends("B1"), ","), "");
-	BOOST_CHECK_EQUAL(join(s.order(), ","), "B1,A2,B2,A1");
+	BOOST_CHECK_EQUAL(join(s.order(), ","), "A2,B2,A1,B1");
+
+	// An edge against the current order shifts only the affected
+	// cells (A1 keeps its position)
+	s.update("A2","= B1");
+	BOOST_CHECK_EQUAL(join(s.depends("A2"), ","), "B1");
+	BOOST_CHECK_EQUAL(join(s.order(), ","), "B1,A2,A1,B2");
+}
+
+BOOST_AUTO_TEST_CASE(ranges){
+	Sheet s;
+	auto spread = std::make_shared<RangeTestSpread>();
+	s.attach(spread);
+	s.cells({
+		{"A1","1"},{"B1","= sum(A1:A5)"},{"C1","3"},
+		{"A2","2"},{"B2","= A1:A2"}
+	});
+
+	BOOST_CHECK_EQUAL(s.translate("A1:A3"),"range(0,0,2,0)");
+	BOOST_CHECK_EQUAL(s.translate("func(B2:C10,A4)"),"func(range(1,1,9,2),A4)");
+
+	// Dependencies are on ranges, not on each cell within them
+	BOOST_CHECK_EQUAL(join(s.depends("B1"), ","), "A1:A5");
+	BOOST_CHECK_EQUAL(join(s.depends("B2"), ","), "A1:A2");
+
+	// Cells within a range precede it, and it precedes cells depending upon it
+	auto order = s.order();
+	auto position = [&](const std::string& id){
+		return std::find(order.begin(), order.end(), id) - order.begin();
+	};
+	BOOST_CHECK(position("A1") < position("A1:A5"));
+	BOOST_CHECK(position("A2") < position("A1:A5"));
+	BOOST_CHECK(position("A1:A5") < position("B1"));
+	BOOST_CHECK(position("A2") < position("A1:A2"));
+	BOOST_CHECK(position("A1:A2") < position("B2"));
+
+	// Ranges are not themselves predecessors or successors, nor a level of dependency
+	auto sorted = [](std::vector<std::string> ids){
+		std::sort(ids.begin(), ids.end());
+		return join(ids, ",");
+	};
+	BOOST_CHECK_EQUAL(sorted(s.predecessors("B1", 1)), "A1,A2");
+	BOOST_CHECK_EQUAL(sorted(s.successors("A1")), "B1,B2");
+
+	// Changing a cell within ranges re-executes the cells depending upon them...
+	spread->sets = 0;
+	s.update("A2","4");
+	BOOST_CHECK_EQUAL(spread->sets, 3u);
+
+	// ...but not a cell outside of them
+	spread->sets = 0;
+	s.update("C1","4");
+	BOOST_CHECK_EQUAL(spread->sets, 1u);
+
+	// New cells within a range are connected to it
+	spread->sets = 0;
+	s.update("A4","5");
+	BOOST_CHECK_EQUAL(spread->sets, 2u);
+	spread->sets = 0;
+	s.update("A4","6");
+	BOOST_CHECK_EQUAL(spread->sets, 2u);
+
+	// Range expressions are only valid within the spread so dumped scripts list the cells instead
+	auto script = s.dump("r");
+	BOOST_CHECK(script.find("range(") == std::string::npos);
+	BOOST_CHECK(script.find("sum([A1,A2,A3,A4,A5])") != std::string::npos);
+
+	// The size of the graph does not depend upon the size of a range
+	auto vertices = s.order().size();
+	s.update("D1","= sum(A1:A100000)");
+	BOOST_CHECK_EQUAL(s.order().size(), vertices + 2);
+
+	// A range including the cell itself is a cyclic dependency
+	s.update("A3","= sum(A1:A5)");
+	BOOST_CHECK_EQUAL(s.cycles().size(), 1u);
+	BOOST_CHECK_EQUAL(join(s.cycles()[0], ","), "A3");
+	BOOST_CHECK_EQUAL(s.cell("A3").type, "error");
+	BOOST_CHECK_EQUAL(s.cell("B1").type, "error");
+	BOOST_CHECK_EQUAL(s.cell("D1").type, "error");
+	BOOST_CHECK(s.cell("B2").type != "error");
+}
+
+BOOST_AUTO_TEST_CASE(translations){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	s.cells({
+		{"A1","1"},{"B1","= A1 * 2"},{"C1","= x * 2"},
+		{"A2","1"},{"B2","= A1 * 2"}
+	});
+	// Each distinct expression is only parsed once
+	BOOST_CHECK_EQUAL(spread->parses, 3u);
+	BOOST_CHECK_EQUAL(join(s.depends("B2"), ","), "A1");
+	BOOST_CHECK_EQUAL(join(s.depends("C1"), ","), "");
+
+	// Updating all cells does not require any parsing
+	s.update();
+	BOOST_CHECK_EQUAL(spread->parses, 3u);
+	s.update("B2","= A1 * 2");
+	BOOST_CHECK_EQUAL(spread->parses, 3u);
+	s.update("B2","= A2 * 2");
+	BOOST_CHECK_EQUAL(spread->parses, 4u);
+	BOOST_CHECK_EQUAL(join(s.depends("B2"), ","), "A2");
+
+	// A new name invalidates the cache
+	s.update("D1","x = 3");
+	BOOST_CHECK_EQUAL(spread->parses, 5u);
+	s.update("C1","= x * 2");
+	BOOST_CHECK_EQUAL(spread->parses, 6u);
+	BOOST_CHECK_EQUAL(join(s.depends("C1"), ","), "D1");
 }
 
 BOOST_AUTO_TEST_CASE(update){
@@ -363,6 +677,539 @@ BOOST_AUTO_TEST_CASE(update){
 		BOOST_CHECK_EQUAL(cell.type, "html");
 		BOOST_CHECK_EQUAL(cell.value, "<p><strong>bold</strong></p>");
 	}
+
+	// Cells can only be identified in A1 notation
+	BOOST_CHECK_THROW(s.update("R1C1", "2"), Exception);
+	BOOST_CHECK_EQUAL(s.cell("A1").value, "1");
+}
+
+BOOST_AUTO_TEST_CASE(update_batch){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	s.cells({
+		{"A1","1"},{"B1","= A1"},{"C1","= B1"},
+		{"A2","2"},{"B2","= A2"},{"C2","= B1 + B2"}
+	});
+	// All cells are set in a single batch
+	BOOST_CHECK_EQUAL(spread->sets, 6u);
+	BOOST_CHECK_EQUAL(spread->batches, 1u);
+	BOOST_CHECK_EQUAL(s.cell("C2").value, "B1 + B2");
+
+	// Changed cells are set in the same batch but the batch is
+	// split when the value of a cell is needed to determine whether
+	// its successors are set
+	spread->sets = 0;
+	spread->batches = 0;
+	Sheet::Cell a1, a2, b1;
+	a1.id = "A1";
+	a1.source("3");
+	a2.id = "A2";
+	a2.source("4");
+	s.update({a1, a2});
+	BOOST_CHECK_EQUAL(spread->sets, 4u);
+	BOOST_CHECK_EQUAL(spread->batches, 2u);
+
+	// Cells preceding a blank cell are set before it is cleared
+	spread->sets = 0;
+	spread->batches = 0;
+	a1.source("4");
+	b1.id = "B1";
+	b1.source("");
+	s.update({a1, b1});
+	BOOST_CHECK_EQUAL(spread->sets, 3u);
+	BOOST_CHECK_EQUAL(spread->batches, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(update_cutoff){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	// The value of a cell in a `TestSpread` is its expression so
+	// the values of B1 and C1 do not change when A1 does
+	s.cells({
+		{"A1","1"},{"B1","= A1"},{"C1","= B1"}
+	});
+	BOOST_CHECK_EQUAL(spread->sets, 3u);
+
+	// A changed value re-executes immediate successors but, since
+	// the value of B1 is unchanged, C1 is not re-executed
+	spread->sets = 0;
+	auto updates = s.update("A1","2");
+	BOOST_CHECK_EQUAL(spread->sets, 2u);
+	BOOST_CHECK_EQUAL(updates.size(), 1u);
+	BOOST_CHECK_EQUAL(s.cell("A1").hash, Sheet::Cell(s.cell("A1")).rehash().hash);
+
+	// A changed cell with an unchanged value is returned but
+	// does not re-execute successors
+	spread->sets = 0;
+	updates = s.update("A1","2");
+	BOOST_CHECK_EQUAL(spread->sets, 1u);
+	BOOST_CHECK_EQUAL(updates.size(), 1u);
+
+	// A changed value of an intermediate cell re-executes its successors
+	spread->sets = 0;
+	updates = s.update("B1","= A1 + 1");
+	BOOST_CHECK_EQUAL(spread->sets, 2u);
+	BOOST_CHECK_EQUAL(updates.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(update_changed){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	s.cells({
+		{"A1","1"},{"B1","= A1"}
+	});
+
+	// A changed cell is always returned, even if its value is unchanged,
+	// so that clients get its new source, name and kind. But, since its value
+	// is unchanged, its successors are not executed or returned.
+	spread->sets = 0;
+	auto updates = s.update("A1","x = 1");
+	BOOST_CHECK_EQUAL(spread->sets, 1u);
+	BOOST_REQUIRE_EQUAL(updates.size(), 1u);
+	BOOST_CHECK_EQUAL(updates[0].id, "A1");
+	BOOST_CHECK_EQUAL(updates[0].name, "x");
+	BOOST_CHECK_EQUAL(updates[0].value, "1");
+
+	// Likewise for a cell with an unchanged source
+	spread->sets = 0;
+	updates = s.update("A1","x = 1");
+	BOOST_CHECK_EQUAL(spread->sets, 1u);
+	BOOST_REQUIRE_EQUAL(updates.size(), 1u);
+	BOOST_CHECK_EQUAL(updates[0].id, "A1");
+}
+
+BOOST_AUTO_TEST_CASE(update_concurrent){
+	Sheet s;
+	auto spread = std::make_shared<ThreadsafeTestSpread>();
+	s.attach(spread);
+
+	std::vector<std::array<std::string, 2>> sources = {{"A1", "1"}};
+	for (unsigned int row = 0; row < 20; row++) {
+		sources.push_back({Sheet::identify(row, 1), "= A1"});
+	}
+	sources.push_back({"C1", "= B1 + B20"});
+	s.cells(sources);
+
+	BOOST_CHECK_EQUAL(spread->sets, 22);
+	BOOST_CHECK_EQUAL(s.cell("B10").value, "A1");
+	BOOST_CHECK_EQUAL(s.cell("C1").value, "B1 + B20");
+
+	// Cells must be set after the cells they depend upon
+	auto& history = spread->history;
+	BOOST_CHECK_EQUAL(history.front(), "A1");
+	BOOST_CHECK_EQUAL(history.back(), "C1");
+
+	// A change only executes successors
+	spread->sets = 0;
+	auto updates = s.update("B5", "= 42");
+	BOOST_CHECK_EQUAL(spread->sets, 1);
+	BOOST_CHECK_EQUAL(updates.size(), 1);
+	BOOST_CHECK_EQUAL(s.cell("B5").value, "42");
+}
+
+BOOST_AUTO_TEST_CASE(update_async){
+	Sheet s;
+	auto spread = std::make_shared<ThreadsafeTestSpread>(2);
+	s.attach(spread);
+
+	// A chain of cells, each of which is in a separate level
+	std::vector<Sheet::Cell> changes;
+	for (unsigned int row = 0; row < 10; row++) {
+		Sheet::Cell cell;
+		cell.id = Sheet::identify(row, 0);
+		cell.source(row == 0 ? "1" : "= " + Sheet::identify(row - 1, 0));
+		changes.push_back(cell);
+	}
+
+	// Cells are notified as they are computed
+	std::vector<std::string> notified;
+	std::promise<bool> done;
+	s.update_async(changes, [&](const Sheet::Cell& cell){
+		notified.push_back(cell.id);
+	}, [&](bool cancelled, const std::string& error){
+		done.set_value(cancelled);
+	});
+	BOOST_CHECK_EQUAL(done.get_future().get(), false);
+	BOOST_CHECK_EQUAL(join(notified, ","), "A1,A2,A3,A4,A5,A6,A7,A8,A9,A10");
+
+	// A subsequent update (started here once the first cell has been computed)
+	// cancels the update in progress and executes the cells that it had not
+	for (auto& cell : changes) cell.source(cell.source() + " + 1");
+	Sheet::Cell b1;
+	b1.id = "B1";
+	b1.source("2");
+	std::vector<std::string> notified_first, notified_second;
+	std::promise<bool> done_first, done_second;
+	spread->sets = 0;
+	s.update_async(changes, [&](const Sheet::Cell& cell){
+		notified_first.push_back(cell.id);
+		if (notified_first.size() == 1) {
+			s.update_async({b1}, [&](const Sheet::Cell& cell){
+				notified_second.push_back(cell.id);
+			}, [&](bool cancelled, const std::string& error){
+				done_second.set_value(cancelled);
+			});
+		}
+	}, [&](bool cancelled, const std::string& error){
+		done_first.set_value(cancelled);
+	});
+	BOOST_CHECK_EQUAL(done_first.get_future().get(), true);
+	BOOST_CHECK_EQUAL(done_second.get_future().get(), false);
+	BOOST_CHECK_EQUAL(join(notified_first, ","), "A1");
+	BOOST_CHECK_EQUAL(notified_second.size(), 10u);
+	BOOST_CHECK_EQUAL(spread->sets, 11u);
+	BOOST_CHECK_EQUAL(s.cell("A10").value, "A9 + 1");
+
+	// Only the cells whose inputs have changed are left for the subsequent update
+	// (here A2, whose value does not change, so A3 onwards are not executed)
+	Sheet::Cell a1 = changes[0];
+	a1.source("3");
+	bool a2_stale = false, a3_stale = true;
+	std::vector<std::string> notified_third;
+	std::promise<bool> done_third, done_fourth;
+	spread->sets = 0;
+	s.update_async({a1}, [&](const Sheet::Cell& cell){
+		if (cell.id == "A1") {
+			s.update_async({b1}, [&](const Sheet::Cell& cell){
+				notified_third.push_back(cell.id);
+			}, [&](bool cancelled, const std::string& error){
+				done_fourth.set_value(cancelled);
+			});
+		}
+	}, [&](bool cancelled, const std::string& error){
+		a2_stale = s.stale("A2");
+		a3_stale = s.stale("A3");
+		done_third.set_value(cancelled);
+	});
+	BOOST_CHECK_EQUAL(done_third.get_future().get(), true);
+	BOOST_CHECK_EQUAL(done_fourth.get_future().get(), false);
+	BOOST_CHECK(a2_stale);
+	BOOST_CHECK(not a3_stale);
+	std::sort(notified_third.begin(), notified_third.end());
+	BOOST_CHECK_EQUAL(join(notified_third, ","), "A2,B1");
+	BOOST_CHECK_EQUAL(spread->sets, 3u);
+
+	// Exceptions are passed on
+	Sheet::Cell b2;
+	b2.id = "foo";
+	b2.source("1");
+	std::promise<std::string> error;
+	s.update_async({b2}, [](const Sheet::Cell& cell){}, [&](bool cancelled, const std::string& message){
+		error.set_value(message);
+	});
+	BOOST_CHECK(error.get_future().get().length() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(lazy){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	s.lazy(true);
+	s.viewport(0, 0, 1, 0);
+	BOOST_CHECK(s.lazy());
+	BOOST_CHECK_EQUAL(s.viewport()[2], 1u);
+
+	// Only cells in the viewport, and those that they depend upon, are executed
+	s.cells({
+		{"A1","1"},{"B1","3"},{"C1","= A1"},
+		{"A2","= B1"},
+		{"A10","4"}
+	});
+	BOOST_CHECK_EQUAL(spread->sets, 3u);
+	BOOST_CHECK(not s.stale("A1"));
+	BOOST_CHECK(not s.stale("B1"));
+	BOOST_CHECK(s.stale("C1"));
+	BOOST_CHECK(s.stale("A10"));
+
+	// Stale cells are executed on demand...
+	auto updates = s.compute({"C1"});
+	BOOST_CHECK_EQUAL(spread->sets, 4u);
+	BOOST_CHECK_EQUAL(updates.size(), 1u);
+	BOOST_CHECK_EQUAL(s.cell("C1").value, "A1");
+	BOOST_CHECK(not s.stale("C1"));
+
+	// ...or when they come into view
+	updates = s.viewport(9, 0, 9, 0);
+	BOOST_CHECK_EQUAL(spread->sets, 5u);
+	BOOST_CHECK_EQUAL(updates.size(), 1u);
+	BOOST_CHECK(not s.stale("A10"));
+
+	// Changes outside of the viewport are not executed until needed, along
+	// with any stale cells they depend upon
+	s.update("A1","5");
+	BOOST_CHECK_EQUAL(spread->sets, 5u);
+	BOOST_CHECK(s.stale("A1"));
+	BOOST_CHECK(s.stale("C1"));
+	s.compute({"C1"});
+	BOOST_CHECK_EQUAL(spread->sets, 7u);
+	BOOST_CHECK_EQUAL(s.cell("A1").value, "5");
+	BOOST_CHECK(not s.stale("A1"));
+
+	// Turning lazy mode off executes all stale cells
+	s.update("B1","6");
+	BOOST_CHECK_EQUAL(spread->sets, 7u);
+	s.lazy(false);
+	s.update("A10","7");
+	BOOST_CHECK_EQUAL(spread->sets, 10u);
+	BOOST_CHECK(not s.stale("A2"));
+}
+
+BOOST_AUTO_TEST_CASE(tile){
+	Sheet s;
+	auto spread = std::make_shared<TestSpread>();
+	s.attach(spread);
+	s.lazy(true);
+	s.viewport(0, 0, 1, 1);
+	s.cells({
+		{"A1","1"},{"B2","2"},{"C2","3"},{"B3","= B2"},{"D10","4"}
+	});
+	BOOST_CHECK(s.stale("D10"));
+
+	auto tile = s.tile(1, 1, 2, 2);
+	BOOST_CHECK_EQUAL(tile["row"].as<int>(), 1);
+	BOOST_CHECK_EQUAL(tile["cols"].as<int>(), 2);
+	BOOST_CHECK_EQUAL(tile["cells"].size(), 3u);
+	BOOST_CHECK_EQUAL(tile["cells"][0]["id"].as<std::string>(), "B2");
+	BOOST_CHECK_EQUAL(tile["cells"][1]["id"].as<std::string>(), "B3");
+	BOOST_CHECK(tile["cells"][1]["stale"].as<bool>());
+	BOOST_CHECK_EQUAL(tile["cells"][2]["id"].as<std::string>(), "C2");
+
+	BOOST_CHECK_EQUAL(s.tile(10, 0, 5, 5)["cells"].size(), 0u);
+	BOOST_CHECK_EQUAL(s.tile(0, 0, 0, 0)["cells"].size(), 0u);
+
+	// The tile is stale until requested using the method, which executes stale cells
+	BOOST_CHECK(s.tile(9, 3, 1, 1)["cells"][0]["stale"].as<bool>());
+	auto result = s.call("tile", Stencila::Json::Document("[9,3,1,1]"));
+	BOOST_CHECK_EQUAL(result["cells"].size(), 1u);
+	BOOST_CHECK_EQUAL(result["cells"][0]["value"].as<std::string>(), "4");
+	BOOST_CHECK(not s.stale("D10"));
+}
+
+BOOST_AUTO_TEST_CASE(html_table){
+	Sheet s;
+	s.attach(std::make_shared<TestSpread>());
+	s.cells({
+		{"A1","1"},{"C3","2"},{"Z1000","3"}
+	});
+
+	// Only cells within the window are rendered
+	auto table = s.html_table(2, 3, 1, 1);
+	BOOST_CHECK_EQUAL(table.select("table").attr("data-rows"), "1000");
+	BOOST_CHECK_EQUAL(table.select("table").attr("data-cols"), "26");
+	BOOST_CHECK_EQUAL(table.select("table").attr("data-row"), "1");
+	BOOST_CHECK_EQUAL(table.filter("tbody tr").size(), 2u);
+	BOOST_CHECK_EQUAL(table.filter("tbody td").size(), 6u);
+	BOOST_CHECK_EQUAL(table.filter("thead th")[1].text(), "B");
+	BOOST_CHECK_EQUAL(table.filter("tbody th")[0].text(), "2");
+	BOOST_CHECK_EQUAL(table.filter("td[data-kind]").size(), 1u);
+	BOOST_CHECK_EQUAL(table.filter("td[data-kind]")[0].text(), "2");
+}
+
+BOOST_AUTO_TEST_CASE(tests){
+	Sheet s;
+	s.attach(std::make_shared<TestSpread>());
+	s.cells({
+		{"A1","1"},{"B1","= A1 * 2"},{"C1","? B2 > 0"},
+		           {"B2","= B1 + 1"},{"C2","? B2 < 10"},
+		           {"B3","= A1"},    {"C3","? D1 == 1"}
+	});
+	s.cell("C1").value = "true";
+	s.cell("C2").value = "false";
+
+	auto results = s.test();
+	BOOST_CHECK_EQUAL(results["cells"].as<int>(), 7);
+	BOOST_CHECK_EQUAL(results["expressions"].as<int>(), 3);
+	BOOST_CHECK_EQUAL(results["tests"].as<int>(), 3);
+	BOOST_CHECK_EQUAL(results["passes"].as<int>(), 1);
+	BOOST_CHECK_EQUAL(results["fails"].as<int>(), 1);
+	// B1 and B2 are covered (B2 by two tests but only counted once)
+	BOOST_CHECK_EQUAL(results["covered"].as<int>(), 2);
+
+	// Coverage is updated when dependencies change
+	s.update("C3","? B3 == 1");
+	BOOST_CHECK_EQUAL(s.test()["covered"].as<int>(), 3);
+	s.update("C1","= B2 > 0");
+	s.update("C2","= B2 < 10");
+	BOOST_CHECK_EQUAL(s.test()["covered"].as<int>(), 1);
+	BOOST_CHECK_EQUAL(s.test()["expressions"].as<int>(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(read_write){
+	auto dir = (
+		boost::filesystem::temp_directory_path()/
+		boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%")
+	).string();
+
+	// A source longer than the chunk size used when reading
+	std::string longer(3 << 20, 'x');
+
+	Sheet s1;
+	s1.cells({
+		{"A1","1"},{"B1","= A1\t+\\1"},
+		{"A2","x = 'a\nb'"},{"C3","'" + longer + "'"}
+	});
+	s1.cell("B1").value = "a\tb";
+	s1.cell("A2").value = "'a\nb'";
+	s1.cell("C3").value = longer;
+	s1.write(dir);
+
+	Sheet s2;
+	s2.read(dir);
+	BOOST_CHECK_EQUAL(s2.cell("A1").source(), "1");
+	BOOST_CHECK_EQUAL(s2.cell("B1").source(), s1.cell("B1").source());
+	BOOST_CHECK_EQUAL(s2.cell("B1").value, s1.cell("B1").value);
+	BOOST_CHECK_EQUAL(s2.cell("A2").name, "x");
+	BOOST_CHECK_EQUAL(s2.cell("A2").value, "'a\nb'");
+	BOOST_CHECK_EQUAL(s2.cell("C3").value.size(), longer.size());
+	BOOST_CHECK_EQUAL(s2.cell("C3").expression.size(), longer.size() + 2);
+
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(read_invalid_id){
+	auto dir = (
+		boost::filesystem::temp_directory_path()/
+		boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%")
+	).string();
+	boost::filesystem::create_directories(dir + "/out");
+	{
+		std::ofstream sheet(dir + "/sheet.tsv");
+		sheet << "A1\t1\nR1C1\t2\nB1\t= A1\n";
+		std::ofstream out(dir + "/out/out.tsv");
+		out << "A1\tinteger\t1\nR1C1\tinteger\t2\nB1\tinteger\t1\n";
+	}
+
+	// Lines with an invalid id are skipped, the rest of the sheet is still read
+	Sheet s;
+	BOOST_CHECK_NO_THROW(s.read(dir));
+	BOOST_CHECK_EQUAL(s.cell("A1").source(), "1");
+	BOOST_CHECK_EQUAL(s.cell("A1").value, "1");
+	BOOST_CHECK_EQUAL(s.cell("B1").expression, "A1");
+	BOOST_CHECK_EQUAL(s.cell("B1").value, "1");
+
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(read_write_cache){
+	auto dir = (
+		boost::filesystem::temp_directory_path()/
+		boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%")
+	).string();
+
+	Sheet s1;
+	s1.attach(std::make_shared<TestSpread>());
+	s1.cells({
+		{"A1","1"},{"B1","= A1"},{"C1","= B1"},{"D1","= C1 + A1"}
+	});
+	s1.write(dir);
+
+	// Cells with unchanged inputs are restored without being executed
+	{
+		Sheet s2;
+		auto spread = std::make_shared<TestSpread>();
+		s2.attach(spread);
+		s2.read(dir);
+		s2.update();
+		BOOST_CHECK_EQUAL(spread->sets, 0u);
+		BOOST_CHECK_EQUAL(s2.cell("D1").value, "C1 + A1");
+	}
+
+	// Only cells with changed inputs are executed
+	{
+		Sheet s2;
+		auto spread = std::make_shared<TestSpread>();
+		s2.attach(spread);
+		s2.read(dir);
+		Sheet::Cell b1;
+		b1.id = "B1";
+		b1.source("= A1 + 1");
+		s2.update({b1});
+		BOOST_CHECK_EQUAL(spread->sets, 2u);
+		BOOST_CHECK_EQUAL(s2.cell("B1").value, "A1 + 1");
+	}
+
+	// Without an attached spread nothing is restored
+	{
+		Sheet s2;
+		s2.read(dir);
+		auto spread = std::make_shared<TestSpread>();
+		s2.attach(spread);
+		s2.update();
+		BOOST_CHECK_EQUAL(spread->sets, 4u);
+	}
+
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(load){
+	Sheet s;
+	s.load("1\t= A1\n\n\t3");
+	BOOST_CHECK_EQUAL(s.cell("A1").source(), "1");
+	BOOST_CHECK_EQUAL(s.cell("B1").source(), "= A1");
+	BOOST_CHECK_EQUAL(s.cell("B3").source(), "3");
+	BOOST_CHECK(s.cell_pointer("A3") == nullptr);
+	BOOST_CHECK_EQUAL(s.dump(), "1\t= A1\n\n\t3\n");
+}
+
+BOOST_AUTO_TEST_CASE(binary){
+	Sheet s1;
+	s1.attach(std::make_shared<TestSpread>());
+	s1.cells({
+		{"A1","1"},{"B1","x = A1"},{"C1","= x + 'a\tb'"},{"A2","^ library(foo)"},
+		{"AA10","? A1 == 1"},{"B3","Hello"},{"C3",""}
+	});
+	s1.cell("B1").display("exp");
+
+	// Round trip through a string
+	auto binary = s1.dump("bin");
+	Sheet s2;
+	s2.load(binary, "bin");
+	BOOST_CHECK_EQUAL(s2.dump(), s1.dump());
+	for (std::string id : {"A1","B1","C1","A2","AA10","B3"}) {
+		const auto& cell1 = s1.cell(id);
+		const auto& cell2 = s2.cell(id);
+		BOOST_CHECK_EQUAL(cell2.id, id);
+		BOOST_CHECK_EQUAL(cell2.kind, cell1.kind);
+		BOOST_CHECK_EQUAL(cell2.name, cell1.name);
+		BOOST_CHECK_EQUAL(cell2.expression, cell1.expression);
+		BOOST_CHECK_EQUAL(cell2.display_specified(), cell1.display_specified());
+		BOOST_CHECK_EQUAL(cell2.type, cell1.type);
+		BOOST_CHECK_EQUAL(cell2.value, cell1.value);
+		BOOST_CHECK_EQUAL(cell2.hash, cell1.hash);
+	}
+	BOOST_CHECK_EQUAL(s2.cell("B1").display(), "exp");
+
+	// Names are restored
+	s2.attach(std::make_shared<TestSpread>());
+	s2.update("D1", "= x");
+	BOOST_CHECK_EQUAL(s2.depends("D1").size(), 1u);
+	BOOST_CHECK_EQUAL(s2.depends("D1")[0], "B1");
+
+	// Round trip through a (memory mapped) file
+	auto path = (
+		boost::filesystem::temp_directory_path()/
+		boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%.bin")
+	).string();
+	s1.export_(path);
+	Sheet s3;
+	s3.import(path);
+	BOOST_CHECK_EQUAL(s3.dump(), s1.dump());
+	BOOST_CHECK_EQUAL(s3.cell("AA10").value, s1.cell("AA10").value);
+	boost::filesystem::remove(path);
+
+	// An empty sheet
+	Sheet s4;
+	s2.load(s4.dump("bin"), "bin");
+	BOOST_CHECK_EQUAL(s2.dump(), s4.dump());
+	BOOST_CHECK(s2.cell_pointer("A1") == nullptr);
+
+	// Invalid data
+	BOOST_CHECK_THROW(s2.load("STB1", "bin"), Exception);
+	BOOST_CHECK_THROW(s2.load(binary.substr(0, binary.size() - 1), "bin"), Exception);
+	BOOST_CHECK_THROW(s2.load("1\t2", "bin"), Exception);
 }
 
 BOOST_AUTO_TEST_CASE(request){
@@ -404,6 +1251,363 @@ BOOST_AUTO_TEST_CASE(request){
 BOOST_AUTO_TEST_SUITE_END()
 
 
+BOOST_AUTO_TEST_SUITE(sheet_slow)
+
+BOOST_AUTO_TEST_CASE(update_latency){
+	// Latency of a single edit should be flat in sheet size: only the
+	// changed cell and its successors are ordered and executed
+	for (unsigned int rows : {500, 5000, 25000}) {
+		Sheet s;
+		auto spread = std::make_shared<TestSpread>();
+		s.attach(spread);
+
+		std::vector<std::array<std::string, 2>> sources;
+		for (unsigned int row = 0; row < rows; row++) {
+			sources.push_back({Sheet::identify(row, 0), string(row)});
+			sources.push_back({Sheet::identify(row, 1), "= " + Sheet::identify(row, 0)});
+		}
+		s.cells(sources);
+
+		const unsigned int edits = 100;
+		spread->sets = 0;
+		boost::timer::cpu_timer timer;
+		for (unsigned int edit = 0; edit < edits; edit++) {
+			auto row = (edit * 7919) % rows;
+			s.update(Sheet::identify(row, 0), string(rows + edit));
+		}
+		timer.stop();
+
+		BOOST_CHECK_EQUAL(spread->sets, edits * 2);
+		BOOST_TEST_MESSAGE(
+			"update_latency cells=" << rows * 2 <<
+			" ms/edit=" << timer.elapsed().wall / 1e6 / edits
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(update_recalculation){
+	// Full recalculation should be linear in the number of cells for
+	// both a long chain of dependencies and a wide fan-out
+	const unsigned int rows = 100000;
+	for (std::string shape : {"chain", "fan-out"}) {
+		Sheet s;
+		auto spread = std::make_shared<TestSpread>();
+		s.attach(spread);
+
+		std::vector<std::array<std::string, 2>> sources = {{"A1", "1"}};
+		for (unsigned int row = 1; row < rows; row++) {
+			auto depend = (shape == "chain") ? Sheet::identify(row - 1, 0) : "A1";
+			sources.push_back({Sheet::identify(row, 0), "= " + depend});
+		}
+		s.cells(sources);
+
+		spread->sets = 0;
+		boost::timer::cpu_timer timer;
+		s.update();
+		timer.stop();
+		BOOST_CHECK_EQUAL(spread->sets, rows);
+
+		BOOST_TEST_MESSAGE(
+			"update_recalculation shape=" << shape << " cells=" << rows <<
+			" ms=" << timer.elapsed().wall / 1e6
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(update_lazy){
+	// In lazy mode, the number of cells executed when opening a large sheet
+	// should depend upon the size of the viewport, not the sheet
+	// (cells take 1ms to evaluate)
+	const unsigned int rows = 2000;
+	std::vector<std::array<std::string, 2>> sources;
+	for (unsigned int row = 0; row < rows; row++) {
+		sources.push_back({Sheet::identify(row, 0), string(row)});
+		sources.push_back({Sheet::identify(row, 1), "= " + Sheet::identify(row, 0)});
+	}
+	for (bool lazy : {false, true}) {
+		Sheet s;
+		auto spread = std::make_shared<ThreadsafeTestSpread>(1, 1);
+		s.attach(spread);
+		s.lazy(lazy);
+
+		boost::timer::cpu_timer timer;
+		s.cells(sources);
+		timer.stop();
+		BOOST_CHECK_EQUAL(spread->sets, lazy ? 100u : rows * 2);
+
+		BOOST_TEST_MESSAGE(
+			"update_lazy lazy=" << lazy << " cells=" << rows * 2 << " sets=" << spread->sets <<
+			" ms=" << timer.elapsed().wall / 1e6
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(binary_vs_tsv){
+	// Size and speed of storing and restoring a sheet using the binary 
+	// format compared to the TSV sources and outputs files
+	const unsigned int rows = 50000;
+	std::vector<std::array<std::string, 2>> sources;
+	for (unsigned int row = 0; row < rows; row++) {
+		sources.push_back({Sheet::identify(row, 0), string(row * 1.5)});
+		sources.push_back({Sheet::identify(row, 1), "= " + Sheet::identify(row, 0) + " * 2"});
+	}
+	Sheet s1;
+	s1.attach(std::make_shared<TestSpread>());
+	s1.cells(sources);
+
+	auto dir = (
+		boost::filesystem::temp_directory_path()/
+		boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%")
+	).string();
+	auto bin = dir + "/out/sheet.bin";
+
+	boost::timer::cpu_timer timer;
+	s1.write(dir);
+	auto tsv_write = timer.elapsed().wall / 1e6;
+	timer.start();
+	s1.export_(bin);
+	auto bin_write = timer.elapsed().wall / 1e6;
+
+	// Only compare to the TSV files
+	boost::filesystem::remove(dir + "/out/cache.bin");
+	auto tsv_size = boost::filesystem::file_size(dir + "/sheet.tsv") + boost::filesystem::file_size(dir + "/out/out.tsv");
+	auto bin_size = boost::filesystem::file_size(bin);
+
+	Sheet s2;
+	timer.start();
+	s2.read(dir);
+	auto tsv_read = timer.elapsed().wall / 1e6;
+	Sheet s3;
+	timer.start();
+	s3.import(bin);
+	auto bin_read = timer.elapsed().wall / 1e6;
+
+	BOOST_CHECK_EQUAL(s3.cell("B100").value, s2.cell("B100").value);
+	BOOST_CHECK_EQUAL(s3.cell("B100").source(), s2.cell("B100").source());
+	BOOST_CHECK(bin_size < tsv_size);
+
+	BOOST_TEST_MESSAGE(
+		"binary_vs_tsv cells=" << rows * 2 <<
+		" tsv_bytes=" << tsv_size << " bin_bytes=" << bin_size <<
+		" tsv_write_ms=" << tsv_write << " bin_write_ms=" << bin_write <<
+		" tsv_read_ms=" << tsv_read << " bin_read_ms=" << bin_read
+	);
+
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(update_concurrent_speedup){
+	// A wide fan-out of cells which are slow to evaluate should
+	// be faster to update with a spread allowing concurrency
+	for (unsigned int concurrency : {1, 2, 4, 8}) {
+		Sheet s;
+		auto spread = std::make_shared<ThreadsafeTestSpread>(concurrency, 5);
+		s.attach(spread);
+
+		std::vector<std::array<std::string, 2>> sources = {{"A1", "1"}};
+		for (unsigned int row = 0; row < 200; row++) {
+			sources.push_back({Sheet::identify(row, 1), "= A1"});
+		}
+		boost::timer::cpu_timer timer;
+		s.cells(sources);
+		timer.stop();
+
+		BOOST_CHECK_EQUAL(spread->sets, 201);
+		BOOST_TEST_MESSAGE(
+			"update_concurrent_speedup concurrency=" << concurrency <<
+			" ms=" << timer.elapsed().wall / 1e6
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(ids){
+	// Parsing and formatting of cell ids
+	const unsigned int count = 1000000;
+	std::vector<std::string> ids(count);
+	for (unsigned int index = 0; index < count; index++) {
+		ids[index] = Sheet::identify(index % 10000, index % 1000);
+	}
+
+	#define BENCHMARK(name_, code_) { \
+		boost::timer::cpu_timer timer; \
+		code_; \
+		timer.stop(); \
+		BOOST_TEST_MESSAGE( \
+			"ids " << name_ << " count=" << count << \
+			" ns/call=" << timer.elapsed().wall / double(count) \
+		); \
+	}
+
+	unsigned int valid = 0;
+	BENCHMARK("is_id()", {
+		for (const auto& id : ids) valid += Sheet::is_id(id);
+	})
+	BOOST_CHECK_EQUAL(valid, count);
+
+	unsigned int sum = 0;
+	BENCHMARK("index()", {
+		for (const auto& id : ids) sum += Sheet::index(id)[0];
+	})
+	BENCHMARK("identify()", {
+		for (unsigned int index = 0; index < count; index++) Sheet::identify(index % 10000, index % 1000);
+	})
+	BENCHMARK("identify_col()", {
+		for (unsigned int index = 0; index < count; index++) Sheet::identify_col(index);
+	})
+
+	#undef BENCHMARK
+}
+
+BOOST_AUTO_TEST_CASE(sources){
+	// Parsing of a representative mix of cell sources
+	const unsigned int count = 1000000;
+	std::vector<std::string> sources = {
+		"", "42", "-3.14", "'a string'", "\"another string\"", "Some text",
+		"= A1 * 2", "rate = 0.05", "total = sum(A1:A100)", ": matrix", 
+		"^ library(foo)", "? B2 > 0", "_ some *Cila*"
+	};
+	Sheet::Cell cell;
+	boost::timer::cpu_timer timer;
+	for (unsigned int index = 0; index < count; index++) {
+		cell.source(sources[index % sources.size()]);
+	}
+	timer.stop();
+	BOOST_TEST_MESSAGE(
+		"sources count=" << count <<
+		" ns/source=" << timer.elapsed().wall / double(count)
+	);
+}
+
+BOOST_AUTO_TEST_CASE(tests){
+	// Test coverage of a sheet with many test cells
+	const unsigned int rows = 20000;
+	Sheet s;
+	s.attach(std::make_shared<TestSpread>());
+	std::vector<std::array<std::string, 2>> sources;
+	for (unsigned int row = 0; row < rows; row++) {
+		auto a = Sheet::identify(row, 0);
+		auto b = Sheet::identify(row, 1);
+		sources.push_back({a, string(row)});
+		sources.push_back({b, "= " + a + " * 2 + A1"});
+		sources.push_back({Sheet::identify(row, 2), "? " + b + " > 0"});
+	}
+	s.cells(sources);
+
+	for (auto run : {"first", "cached"}) {
+		boost::timer::cpu_timer timer;
+		auto results = s.test();
+		timer.stop();
+		BOOST_CHECK_EQUAL(results["covered"].as<int>(), rows);
+		BOOST_TEST_MESSAGE(
+			"tests " << run << " tests=" << rows <<
+			" ms=" << timer.elapsed().wall / 1e6
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(cells_access){
+	// Access to cells in a sheet with a million cells
+	const unsigned int rows = 1000;
+	const unsigned int cols = 1000;
+	Sheet s;
+	std::vector<Sheet::Cell> cells;
+	for (unsigned int col = 0; col < cols; col++) {
+		for (unsigned int row = 0; row < rows; row++) {
+			Sheet::Cell cell;
+			cell.id = Sheet::identify(row, col);
+			cell.kind = Sheet::Cell::number_;
+			cell.expression = string(row * col);
+			cells.push_back(cell);
+		}
+	}
+	s.update(cells, false);
+
+	#define BENCHMARK(name_, code_) { \
+		boost::timer::cpu_timer timer; \
+		code_; \
+		timer.stop(); \
+		BOOST_TEST_MESSAGE( \
+			"cells_access " << name_ << " cells=" << rows * cols << \
+			" ms=" << timer.elapsed().wall / 1e6 \
+		); \
+	}
+
+	BENCHMARK("cell(id)", {
+		for (const auto& cell : cells) s.cell(cell.id);
+	})
+	BENCHMARK("cell(row,col)", {
+		for (unsigned int col = 0; col < cols; col++) {
+			for (unsigned int row = 0; row < rows; row++) s.cell(row, col);
+		}
+	})
+	BENCHMARK("extent()", {
+		auto extent = s.extent();
+		BOOST_CHECK_EQUAL(extent[0], rows - 1);
+		BOOST_CHECK_EQUAL(extent[1], cols - 1);
+	})
+	BENCHMARK("dump()", {
+		s.dump();
+	})
+	BENCHMARK("html_table()", {
+		s.html_table(rows, cols);
+	})
+
+	#undef BENCHMARK
+}
+
+BOOST_AUTO_TEST_CASE(read){
+	// Throughput and memory usage of reading a large sheet from disk.
+	// Increase `megabytes` (and the memory limit for tests) to check larger sheets
+	const unsigned int megabytes = 20;
+	auto dir = (
+		boost::filesystem::temp_directory_path()/
+		boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%")
+	).string();
+	boost::filesystem::create_directories(dir + "/out");
+
+	// A mix of cell kinds, five columns wide
+	std::vector<std::string> sources = {"42", "= A1 * 2", "'a string'", "rate = 0.05", "_ some *Cila*"};
+	std::size_t bytes = 0;
+	unsigned int cells = 0;
+	{
+		std::ofstream sheet(dir + "/sheet.tsv");
+		std::ofstream out(dir + "/out/out.tsv");
+		for (unsigned int row = 0; bytes < megabytes * 1e6; row++) {
+			for (unsigned int col = 0; col < sources.size(); col++) {
+				auto id = Sheet::identify(row, col);
+				sheet << id << "\t" << sources[col] << "\n";
+				out << id << "\tstring\t" << row << "\n";
+				bytes += id.size() + sources[col].size() + 2;
+				cells++;
+			}
+		}
+	}
+
+	Sheet s;
+	boost::timer::cpu_timer timer;
+	s.read(dir);
+	timer.stop();
+	BOOST_CHECK_EQUAL(s.cell("B1").expression, "A1 * 2");
+
+	auto seconds = timer.elapsed().wall / 1e9;
+	BOOST_TEST_MESSAGE(
+		"read cells=" << cells << " MB=" << bytes / 1e6 <<
+		" s=" << seconds << " MB/s=" << bytes / 1e6 / seconds
+#if !defined(_WIN32)
+		<< " peak_rss_MB=" << [](){
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			return usage.ru_maxrss / 1024.0;
+		}()
+#endif
+	);
+
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
 #if 0
 BOOST_AUTO_TEST_SUITE(sheet_slow)
 
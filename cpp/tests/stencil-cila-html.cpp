@@ -70,6 +70,8 @@ BOOST_AUTO_TEST_CASE(run) {
                 std::cout<<"****  "<<name<<"  ****"<<std::endl;
                 BOOST_CHECK_EQUAL(html,sections[2]);
             }
+            // Direct conversion should be the same as via a stencil
+            BOOST_CHECK_EQUAL(Stencil::cila_html(sections[1]),stencil.html());
     	}
     	if(direction=="<>" or direction=="<<"){
     		stencil.html(sections[2]);
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/timer/timer.hpp>
 
 #include <stencila/stencil.hpp>
 #include <stencila/map-context.hpp>
@@ -153,6 +154,26 @@ BOOST_AUTO_TEST_CASE(set){
 	BOOST_CHECK_EQUAL(stencil.select("#z [data-error-set-syntax]").text(),"");
 }
 
+BOOST_AUTO_TEST_CASE(set_changed){
+	// Directives are parsed once per attribute value so changing
+	// the attribute between renders must be respected
+	render(R"(
+		<p data-set="x to 42"></p>
+		<p id="x" data-text="x"></p>
+	)");
+	BOOST_CHECK_EQUAL(stencil.select("#x").text(),"42");
+
+	stencil.select("[data-set]").attr("data-set","x to 24");
+	stencil.render();
+	BOOST_CHECK_EQUAL(stencil.select("#x").text(),"24");
+
+	stencil.select("[data-set]").attr("data-set","x");
+	stencil.render();
+	BOOST_CHECK_EQUAL(stencil.select("[data-set]").attr("data-error"),"syntax: x");
+	stencil.render();
+	BOOST_CHECK_EQUAL(stencil.select("[data-set]").attr("data-error"),"syntax: x");
+}
+
 BOOST_AUTO_TEST_CASE(par){
 	render(R"(
 		<div data-par="x type number default 42" />
@@ -313,6 +334,20 @@ BOOST_AUTO_TEST_CASE(for_locked_extras){
 	BOOST_CHECK_EQUAL(stencil.select("li[data-index=\"999\"]").attr("data-extra"),"true");
 }
 
+BOOST_AUTO_TEST_CASE(for_large_index){
+	// Existing children are indexed without allocating for each possible index
+	render(R"(
+		<ul data-for="planet in planets">
+			<li data-text="planet" />
+			<li data-index="1">Should be overwritten</li>
+			<li data-index="2000000000">Should be removed</li>
+		</ul>
+	)");
+
+	BOOST_CHECK_EQUAL(stencil.select("li[data-index=\"1\"]").text(),"Bartledan");
+	BOOST_CHECK(not stencil.select("li[data-index=\"2000000000\"]"));
+}
+
 BOOST_AUTO_TEST_CASE(for_nested){
 	render(R"(
 		<tbody data-for="number in numbers">
@@ -470,3 +505,94 @@ BOOST_AUTO_TEST_CASE(include_par){
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(stencil_render_slow,RenderingFixture)
+
+BOOST_AUTO_TEST_CASE(large){
+	// Rendering a large (~10MB) stencil creates, copies and discards
+	// a very large number of `Xml::Node`s so is sensitive to their cost
+	std::string section = R"(
+		<section>
+			<h2 data-text="a"></h2>
+			<p data-if="z">Shown <span data-text="a"></span></p>
+			<p data-else>Hidden</p>
+			<ul data-for="planet in planets"><li data-text="planet"></li></ul>
+			<p>Some static text which is not rendered at all but which needs to be traversed.</p>
+		</section>
+	)";
+	std::string html;
+	while (html.length() < 10e6) html += section;
+	auto sections = html.length() / section.length();
+
+	stencil.html(html);
+	boost::timer::cpu_timer timer;
+	stencil.render();
+	timer.stop();
+
+	BOOST_CHECK_EQUAL(stencil.select("section h2").text(), "A");
+	BOOST_CHECK_EQUAL(stencil.filter("[data-else]").size(), sections);
+
+	BOOST_TEST_MESSAGE(
+		"render size=" << html.length() << " sections=" << sections <<
+		" ms=" << timer.elapsed().wall / 1e6
+	);
+}
+
+BOOST_AUTO_TEST_CASE(for_large){
+	// Rendering a `for` directive should be linear in the number of items,
+	// both when first rendered and when re-rendered (when existing items are replaced)
+	for(unsigned int items : {1000, 10000, 100000}){
+		Stencil stencil;
+		auto context = std::make_shared<MapContext>();
+		std::string list;
+		for(unsigned int item = 0; item < items; item++) list += (item>0?" ":"") + string(item);
+		context->assign("items",list);
+		stencil.attach(context);
+		stencil.html(std::string(R"(<ul data-for="item in items"><li data-text="item"></li></ul>)"));
+
+		boost::timer::cpu_timer first;
+		stencil.render();
+		first.stop();
+
+		boost::timer::cpu_timer second;
+		stencil.render();
+		second.stop();
+
+		BOOST_CHECK_EQUAL(stencil.filter("li[data-index]").size(), items);
+		BOOST_CHECK_EQUAL(stencil.select("li[data-index=\""+string(items-1)+"\"]").text(), string(items-1));
+
+		BOOST_TEST_MESSAGE(
+			"for items=" << items <<
+			" first_ms=" << first.elapsed().wall / 1e6 <<
+			" second_ms=" << second.elapsed().wall / 1e6
+		);
+
+		stencil.destroy();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(rerender){
+	// Re-rendering a stencil with many directives (e.g. a dashboard after an input has changed)
+	// should not be dominated by re-parsing the directives
+	std::string html;
+	for(int index = 0; index < 10000; index++){
+		html += R"(<div data-if="z"><p data-text="a"></p><p data-set="x to 42"></p><p data-attr="title value a"></p></div>)";
+	}
+	stencil.html(html);
+
+	boost::timer::cpu_timer first;
+	stencil.render();
+	first.stop();
+
+	boost::timer::cpu_timer second;
+	stencil.render();
+	second.stop();
+
+	BOOST_CHECK_EQUAL(stencil.filter("p[title=\"A\"]").size(), 10000u);
+	BOOST_TEST_MESSAGE(
+		"rerender first_ms=" << first.elapsed().wall / 1e6 <<
+		" second_ms=" << second.elapsed().wall / 1e6
+	);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
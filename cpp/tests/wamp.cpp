@@ -25,6 +25,20 @@ BOOST_AUTO_TEST_CASE(call){
 	auto error = call.error("An error");
 	BOOST_CHECK_EQUAL(error[1].as<int>(), Message::CALL);
 	BOOST_CHECK_EQUAL(error[2].as<int>(), 123);
+
+	BOOST_CHECK(not call.progressive());
+	BOOST_CHECK(not result[Message::RESULT_DETAILS].has("progress"));
+}
+
+BOOST_AUTO_TEST_CASE(progressive){
+	Message call(R"([48, 123, {"receive_progress": true}, "address@method", []])");
+	BOOST_CHECK(call.progressive());
+
+	auto result = call.result(R"([{"id":"A1"}])", true);
+	BOOST_CHECK_EQUAL(result.type(), Message::RESULT);
+	BOOST_CHECK_EQUAL(result.request(), 123);
+	BOOST_CHECK_EQUAL(result[Message::RESULT_DETAILS]["progress"].as<bool>(), true);
+	BOOST_CHECK_EQUAL(result[Message::RESULT_ARGS_][0][0]["id"].as<std::string>(), "A1");
 }
 
 BOOST_AUTO_TEST_SUITE_END()
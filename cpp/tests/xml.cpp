@@ -1,5 +1,6 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/timer/timer.hpp>
 
 #include <stencila/xml.hpp>
 
@@ -134,8 +135,13 @@ BOOST_AUTO_TEST_CASE(xpath){
 	CHECK("e + f",              "e/following-sibling::*[name()='f' and (position()=1)]")
 	CHECK("e ~ f",              "e/following-sibling::f")
 	CHECK("div#container p",    "div[@id='container']/descendant::p")
+	CHECK("e, f",               "e | descendant-or-self::f")
 	
 	#undef CHECK
+
+	// Selectors scoped to the children of the context node
+	BOOST_CHECK_EQUAL(Node::xpath("> e"),"child::e");
+	BOOST_CHECK_EQUAL(Node::xpath("> e f, g"),"child::e/descendant::f | descendant-or-self::g");
 }
 
 /*
@@ -174,6 +180,92 @@ BOOST_AUTO_TEST_CASE(one){
 	#undef CHECK
 }
 
+/*
+ * Test that CSS selectors, which are matched natively, select
+ * the same nodes as their XPath equivalents
+ */
+BOOST_AUTO_TEST_CASE(native){
+	Document doc(R"(
+		<div id="a" class="x y">
+			<p id="b" lang="en-GB">B</p>
+			<div id="c">
+				<p id="d" data-index="0">D</p>
+				<p id="e" data-index="1" data-lock="true">E</p>
+			</div>
+			<span id="f">F</span>
+			<span id="g">G</span>
+		</div>
+		<caption id="h" />
+		<figcaption id="i" />
+	)");
+
+	auto ids = [](const Nodes& nodes) -> std::string {
+		std::string ids;
+		for(auto node : nodes) ids += node.attr("id");
+		return ids;
+	};
+	for(std::string selector : {
+		"*","p","div p","div > p","div div p","div.x > p","div.y [data-index]",
+		"p + div","p + span","p ~ span","div#c p[data-lock]",
+		"[lang|=en]","[class~=y]","[id^=a]","[id$=c]","[id*=d]","[data-index='1']"
+	}){
+		BOOST_CHECK_EQUAL(ids(doc.filter(selector)),ids(doc.filter(Node::xpath(selector),"xpath")));
+	}
+
+	// Groups are matched in document order
+	BOOST_CHECK_EQUAL(ids(doc.filter("figcaption, caption, #f")),"fhi");
+	BOOST_CHECK_EQUAL(doc.select("span, p").attr("id"),"b");
+
+	// Selection includes the context node itself...
+	Node c = doc.select("#c");
+	BOOST_CHECK_EQUAL(ids(c.filter("div")),"c");
+	BOOST_CHECK_EQUAL(ids(c.filter("div p")),"de");
+	// ...but not its ancestors or siblings
+	BOOST_CHECK_EQUAL(ids(c.filter("#a p")),"");
+	BOOST_CHECK_EQUAL(ids(c.filter("p ~ div")),"");
+
+	// A leading child combinator scopes the selector to the children of the context node
+	Node a = doc.select("#a");
+	BOOST_CHECK_EQUAL(ids(a.filter("> p")),"b");
+	BOOST_CHECK_EQUAL(ids(a.filter("> div p")),"de");
+	BOOST_CHECK_EQUAL(c.select("> [data-index=\"1\"]").attr("id"),"e");
+	BOOST_CHECK(not a.select("> [data-index]"));
+	BOOST_CHECK_EQUAL(ids(c.filter("> [data-index]")),ids(c.filter("./*[@data-index]","xpath")));
+}
+
+BOOST_AUTO_TEST_CASE(query_cache){
+	Document doc(R"(<div class="a"><p>A</p></div><div class="b"><p>B</p><p>C</p></div>)");
+
+	Node::query_cache(2);
+	BOOST_CHECK_EQUAL(doc.select("div.a p").text(),"A");
+	BOOST_CHECK_EQUAL(doc.select("div.a p").text(),"A");
+	BOOST_CHECK_EQUAL(doc.filter("div.b p").size(),2u);
+	BOOST_CHECK_EQUAL(doc.filter("//div/p","xpath").size(),3u);
+	auto stats = Node::query_cache();
+	BOOST_CHECK_EQUAL(stats.hits,1u);
+	BOOST_CHECK_EQUAL(stats.misses,3u);
+	BOOST_CHECK_EQUAL(stats.size,2u);
+
+	// The least recently used selector was evicted
+	BOOST_CHECK_EQUAL(doc.filter("div.b p").size(),2u);
+	BOOST_CHECK_EQUAL(doc.select("div.a p").text(),"A");
+	stats = Node::query_cache();
+	BOOST_CHECK_EQUAL(stats.hits,2u);
+	BOOST_CHECK_EQUAL(stats.misses,4u);
+
+	// Selectors are keyed by type as well as text
+	BOOST_CHECK_EQUAL(doc.select("p").text(),"A");
+	BOOST_CHECK(not doc.select("p","xpath"));
+	BOOST_CHECK_EQUAL(Node::query_cache().misses,6u);
+
+	// Errors are not cached
+	BOOST_CHECK_THROW(doc.select("//div[","xpath"),Stencila::Exception);
+	BOOST_CHECK_THROW(doc.select("//div[","xpath"),Stencila::Exception);
+	BOOST_CHECK_EQUAL(Node::query_cache().misses,8u);
+
+	Node::query_cache(1000);
+}
+
 BOOST_AUTO_TEST_CASE(sanitize){
 
 	Document doc(R"(
@@ -233,3 +325,48 @@ BOOST_AUTO_TEST_CASE(write_read){
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(xml_slow)
+
+using namespace Stencila::Xml;
+
+BOOST_AUTO_TEST_CASE(native){
+	// Compare the speed of native matching of CSS selectors with
+	// matching of the equivalent XPath
+	Document doc;
+	Node body = doc.append("body");
+	for(int section=0; section<1000; section++){
+		Node div = body.append("div",{{"class","section"},{"id","section-"+std::to_string(section)}});
+		div.append("h2",{{"class","label"}},"Section");
+		Node ul = div.append("ul",{{"data-for","item in items"}});
+		for(int item=0; item<10; item++){
+			ul.append("li",{{"data-index",std::to_string(item)}},"Item");
+		}
+		div.append("figure").append("figcaption",{{"data-lock","true"}},"Figure");
+	}
+
+	for(std::string selector : {
+		"#section-999","[data-lock=\"true\"]",".label","caption,figcaption","div.section > ul li[data-index='9']"
+	}){
+		const int repeats = 100;
+		std::string xpath = Node::xpath(selector);
+		Nodes native, xpathed;
+
+		boost::timer::cpu_timer native_timer;
+		for(int repeat=0; repeat<repeats; repeat++) native = doc.filter(selector);
+		native_timer.stop();
+
+		boost::timer::cpu_timer xpath_timer;
+		for(int repeat=0; repeat<repeats; repeat++) xpathed = doc.filter(xpath,"xpath");
+		xpath_timer.stop();
+
+		BOOST_CHECK_EQUAL(native.size(),xpathed.size());
+		BOOST_TEST_MESSAGE(
+			"native selector=" << selector << " matches=" << native.size() <<
+			" native_ms=" << native_timer.elapsed().wall / 1e6 / repeats <<
+			" xpath_ms=" << xpath_timer.elapsed().wall / 1e6 / repeats
+		);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 
 #include <Rcpp.h>
@@ -45,6 +46,16 @@ public:
         return call_<std::string>(".set", id, expression, name);
     }
 
+    std::vector<std::string> set_batch(const std::vector<std::array<std::string, 3>>& cells) {
+        std::vector<std::string> ids, expressions, names;
+        for (const auto& cell : cells) {
+            ids.push_back(cell[0]);
+            expressions.push_back(cell[1]);
+            names.push_back(cell[2]);
+        }
+        return call_strings_(".set_batch", Rcpp::wrap(ids), Rcpp::wrap(expressions), Rcpp::wrap(names));
+    }
+
     std::string get(const std::string& name) {
         return call_<std::string>(".get", name);
     }
@@ -61,10 +72,19 @@ public:
         return "c(" + join(cells, ",") + ")";
     }
 
+    std::string range(unsigned int row1, unsigned int col1, unsigned int row2, unsigned int col2) {
+        return ".range(" + std::to_string(row1) + "," + std::to_string(col1) + "," + 
+                           std::to_string(row2) + "," + std::to_string(col2) + ")";
+    }
+
     std::string depends(const std::string& expression) {
         return call_<std::string>(".depends", expression);
     }
 
+    std::vector<std::string> depends_batch(const std::vector<std::string>& expressions) {
+        return call_strings_(".depends_batch", Rcpp::wrap(expressions));
+    }
+
     std::vector<std::string> functions(void) {
         return split(call_<std::string>(".functions"), ",");
     }
@@ -129,6 +149,17 @@ private:
         return unstring<Result>(Rcpp::as<std::string>(result));
     }
 
+    /**
+     * Call a method on the R side which returns a character vector
+     * (used for batch methods)
+     */
+    template<typename... Args>
+    std::vector<std::string> call_strings_(const char* name, Args... args){
+        SEXP result = call_(name,args...);
+        if(TYPEOF(result)!=STRSXP) STENCILA_THROW(Exception,"R-side methods should return a string");
+        return Rcpp::as<std::vector<std::string>>(result);
+    }
+
 };
 
 }
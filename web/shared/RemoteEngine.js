@@ -108,14 +108,20 @@ RemoteEngine.Prototype = function() {
 
   // Private, local, methods
 
-  this._call = function(name, args, cb) {
+  /**
+   * Call a method of the remote component
+   *
+   * If `progress` is supplied, and the call is made over the websocket, then the
+   * component may send progressive results before the final result.
+   */
+  this._call = function(name, args, cb, progress) {
     args = args || [];
     if(this.websocket) {
       this.websocket.call(this.address+'@'+name, args, function(result) {
         if (cb) {
           cb(null, result);
         }
-      });
+      }, progress);
     } else {
       this._request('PUT', name, args, function(err, result) {
         if (cb) {
@@ -7,6 +7,8 @@
 function WebsocketConnection(url){
     // Callbacks registered for remote procedure calls (see call() method)
     this.callbacks = {};
+    // Callbacks registered for progressive results of remote procedure calls
+    this.progresses = {};
     // Identifier for messages; incremented in call method
     this.id = 0;
     // Actual websocket
@@ -100,7 +102,14 @@ WebsocketConnection.prototype.receive = function(data){
         // [RESULT, CALL.Request|id, Details|dict, YIELD.Arguments|list]
         var id = message[1];
         console.info('WebsocketConnection.receive. id: '+this.id);
-        var callback = this.callbacks[id];
+        // A progressive result is followed by others, the last of which is not progressive
+        // See https://github.com/wamp-proto/wamp-proto/blob/master/rfc/text/advanced/ap_rpc_progressive_call_results.md
+        var details = message[2] || {};
+        var callback = details.progress ? this.progresses[id] : this.callbacks[id];
+        if(!details.progress){
+            delete this.callbacks[id];
+            delete this.progresses[id];
+        }
         if(callback){
             var results = message[3];
             // WAMP allows for muliple returns
@@ -110,6 +119,9 @@ WebsocketConnection.prototype.receive = function(data){
         }
     }
     else if(code==8){
+        // [ERROR, CALL, CALL.Request|id, Details|dict, Error|uri]
+        delete this.callbacks[message[2]];
+        delete this.progresses[message[2]];
         throw message;
     }
     else {
@@ -124,8 +136,9 @@ WebsocketConnection.prototype.receive = function(data){
  * @param  {String}   method   Name of method to call
  * @param  {Array}    args     Array of arguments
  * @param  {Function} callback Function to call when method returns (potentially with a result)
+ * @param  {Function} progress Function to call with each progressive result (optional)
  */
-WebsocketConnection.prototype.call = function(method,args,callback){
+WebsocketConnection.prototype.call = function(method,args,callback,progress){
     if(arguments.length==1){
         args = [];
         callback = undefined;
@@ -142,14 +155,17 @@ WebsocketConnection.prototype.call = function(method,args,callback){
     var wamp = [
         48,         // CALL
         this.id,    // Request|id
-        {},         // Options|dict
+        progress ? {receive_progress: true} : {}, // Options|dict
         method,     // Procedure|uri
         args        // Arguments|list
     ];
-    // Register callback
+    // Register callbacks
     if(callback){
         this.callbacks[this.id] = callback;
     }
+    if(progress){
+        this.progresses[this.id] = progress;
+    }
     // Send WAMP
     console.info('WebsocketConnection.call. id: '+this.id+' method: '+method);
     this.send(JSON.stringify(wamp));
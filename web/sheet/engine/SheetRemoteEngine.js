@@ -68,9 +68,13 @@ SheetRemoteEngine.Prototype = function() {
   
   /*
     Updates given cells
+
+    `cb` is called with the updated cells. If `progress` is supplied then
+    updated cells may instead be passed to it as soon as each is computed,
+    in which case `cb` is called with the remainder (usually none).
   */
-  this.update = function(cells, cb) {
-    this._call('update', [cells], cb);
+  this.update = function(cells, cb, progress) {
+    this._call('update', [cells], cb, progress);
   };
 
 };
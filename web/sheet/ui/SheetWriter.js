@@ -156,7 +156,7 @@ SheetWriter.Prototype = function() {
         return;
       }
       this._handleUpdates(updates);
-    }.bind(this));
+    }.bind(this), this._handleUpdates.bind(this));
   };
 
   this._handleUpdates = function(updates) {